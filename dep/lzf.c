@@ -0,0 +1,163 @@
+/*
+ * lzf (lempel-ziv free) codec, stream format compatible with liblzf.
+ *
+ * compressed stream is a sequence of:
+ *   000LLLLL <L+1 literal bytes>          literal run, 1..32 bytes
+ *   LLLOOOOO oooooooo                     back ref, len L+2 (L 1..6)
+ *   111OOOOO LLLLLLLL oooooooo            back ref, len L+9
+ * back ref offset is (OOOOO << 8 | oooooooo) + 1, max 8192 bytes.
+ */
+
+#include "lzf.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZF_HLOG 14
+#define LZF_HSIZE (1u << LZF_HLOG)
+#define LZF_MAX_LIT (1 << 5)
+#define LZF_MAX_OFF (1 << 13)
+#define LZF_MAX_REF ((1 << 8) + (1 << 3))
+
+static inline uint32_t lzfHash(const uint8_t* p) {
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - LZF_HLOG);
+}
+
+size_t m_lzf_compress(const void* in_data, size_t in_len, void* out_data,
+                      size_t out_len) {
+    const uint8_t* base = (const uint8_t*)in_data;
+    const uint8_t* ip = base;
+    const uint8_t* in_end = base + in_len;
+    uint8_t* out = (uint8_t*)out_data;
+    uint8_t* op = out;
+    uint8_t* out_end = out + out_len;
+    // input positions, 0 is a valid (checked) position too
+    uint32_t htab[LZF_HSIZE];
+
+    if (in_len == 0 || in_len > UINT32_MAX || out_len < 2) {
+        return 0;
+    }
+    memset(htab, 0, sizeof(htab));
+
+    int lit = 0;
+    uint8_t* lit_ctrl = op++;
+    while (ip < in_end) {
+        if (in_end - ip > 2) {
+            uint32_t h = lzfHash(ip);
+            const uint8_t* ref = base + htab[h];
+            htab[h] = (uint32_t)(ip - base);
+            size_t off = (size_t)(ip - ref) - 1;
+            if (ref < ip && off < LZF_MAX_OFF && ref[0] == ip[0]
+                && ref[1] == ip[1] && ref[2] == ip[2]) {
+                size_t maxlen = (size_t)(in_end - ip);
+                if (maxlen > LZF_MAX_REF) {
+                    maxlen = LZF_MAX_REF;
+                }
+                size_t len = 3;
+                while (len < maxlen && ref[len] == ip[len]) {
+                    len++;
+                }
+
+                // close the literal run, drop the reserved ctrl if empty
+                if (lit > 0) {
+                    *lit_ctrl = (uint8_t)(lit - 1);
+                } else {
+                    op--;
+                }
+                len -= 2;
+                if ((size_t)(out_end - op) < (len < 7 ? 2u : 3u)) {
+                    return 0;
+                }
+                if (len < 7) {
+                    *op++ = (uint8_t)((len << 5) | (off >> 8));
+                } else {
+                    *op++ = (uint8_t)((7 << 5) | (off >> 8));
+                    *op++ = (uint8_t)(len - 7);
+                }
+                *op++ = (uint8_t)(off & 0xff);
+
+                // hash the matched positions for the next refs
+                const uint8_t* end = ip + len + 2;
+                for (ip++; ip < end; ip++) {
+                    if (in_end - ip > 2) {
+                        htab[lzfHash(ip)] = (uint32_t)(ip - base);
+                    }
+                }
+
+                if (op >= out_end) {
+                    return 0;
+                }
+                lit = 0;
+                lit_ctrl = op++;
+                continue;
+            }
+        }
+
+        if (op >= out_end) {
+            return 0;
+        }
+        *op++ = *ip++;
+        if (++lit == LZF_MAX_LIT) {
+            *lit_ctrl = (uint8_t)(lit - 1);
+            if (op >= out_end) {
+                return 0;
+            }
+            lit = 0;
+            lit_ctrl = op++;
+        }
+    }
+
+    if (lit > 0) {
+        *lit_ctrl = (uint8_t)(lit - 1);
+    } else {
+        op--;
+    }
+    return (size_t)(op - out);
+}
+
+size_t m_lzf_decompress(const void* in_data, size_t in_len, void* out_data,
+                        size_t out_len) {
+    const uint8_t* ip = (const uint8_t*)in_data;
+    const uint8_t* in_end = ip + in_len;
+    uint8_t* out = (uint8_t*)out_data;
+    uint8_t* op = out;
+    uint8_t* out_end = out + out_len;
+
+    while (ip < in_end) {
+        unsigned int ctrl = *ip++;
+        if (ctrl < LZF_MAX_LIT) {
+            size_t run = ctrl + 1;
+            if ((size_t)(out_end - op) < run || (size_t)(in_end - ip) < run) {
+                return 0;
+            }
+            memcpy(op, ip, run);
+            op += run;
+            ip += run;
+            continue;
+        }
+
+        size_t len = ctrl >> 5;
+        if (len == 7) {
+            if (ip >= in_end) {
+                return 0;
+            }
+            len += *ip++;
+        }
+        if (ip >= in_end) {
+            return 0;
+        }
+        size_t off = (((size_t)ctrl & 0x1f) << 8) + *ip++ + 1;
+        len += 2;
+        if (off > (size_t)(op - out) || (size_t)(out_end - op) < len) {
+            return 0;
+        }
+        // ref may overlap the output (run length), copy byte by byte
+        const uint8_t* ref = op - off;
+        while (len--) {
+            *op++ = *ref++;
+        }
+    }
+
+    return (size_t)(op - out);
+}
@@ -0,0 +1,27 @@
+/*
+ * lzf (lempel-ziv free) codec, stream format compatible with liblzf
+ * (Marc Lehmann) which redis use to compress rdb strings.
+ * small and fast, no external lib, to compress migrate dump payloads.
+ */
+
+#ifndef __LZF_H_
+#define __LZF_H_
+
+#include <stddef.h>
+
+// compress in_len bytes from in_data to out_data (at most out_len bytes).
+// return compressed len, 0 if the result don't fit in out_len
+// (incompressible data), so use out_len < in_len to skip poor ratio data.
+size_t m_lzf_compress(const void* in_data, size_t in_len, void* out_data,
+                      size_t out_len);
+
+// max decompressed/compressed len ratio, a 3 bytes back ref expands to
+// 264 bytes, bound the decompress out_len of untrusted input with it.
+#define M_LZF_MAX_EXPAND 88
+
+// decompress in_len bytes from in_data to out_data (at most out_len bytes).
+// return decompressed len, 0 if out_len is too small or the data is corrupt.
+size_t m_lzf_decompress(const void* in_data, size_t in_len, void* out_data,
+                        size_t out_len);
+
+#endif /* __LZF_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+// slot hash and slot keys dict type, no redis server dependence,
+// so it can be linked by tests/bench/slots_bench.c
+
+uint64_t dictModuleStrHash(const void* key) {
+    size_t len;
+    const char* buf = RedisModule_StringPtrLen(key, &len);
+    return m_dictGenHashFunction(buf, (int)len);
+}
+
+int dictModuleStrKeyCompare(void* privdata, const void* key1,
+                            const void* key2) {
+    size_t l1, l2;
+    DICT_NOTUSED(privdata);
+
+    const char* buf1 = RedisModule_StringPtrLen(key1, &l1);
+    const char* buf2 = RedisModule_StringPtrLen(key2, &l2);
+    if (l1 != l2)
+        return 0;
+    return memcmp(buf1, buf2, l1) == 0;
+}
+
+void dictModuleKeyDestructor(void* privdata, void* val) {
+    DICT_NOTUSED(privdata);
+    if (val == NULL) {
+        return;
+    }
+    // other threads may still use the key read from slot index, see slotsepoch
+    if (g_slots_meta_info.slot_locking) {
+        SlotsEpoch_RetireKey(val);
+        return;
+    }
+    RedisModule_FreeString(NULL, val);
+}
+
+void dictModuleValueDestructor(void* privdata, void* val) {
+    DICT_NOTUSED(privdata);
+    if (val) {
+        RedisModule_FreeString(NULL, val);
+    }
+}
+
+m_dictType hashSlotDictType = {
+    dictModuleStrHash,        /* hash function */
+    NULL,                     /* key dup */
+    NULL,                     /* val dup */
+    dictModuleStrKeyCompare,  /* key compare */
+    dictModuleKeyDestructor,  /* key destructor */
+    dictModuleValueDestructor /* val destructor */
+};
+
+/*
+ * params s key, plen tag len
+ * return tag start pos char *
+ */
+static const char* slots_tag(const char* s, int* plen) {
+    int i, j, n = strlen(s);
+    for (i = 0; i < n && s[i] != '{'; i++) {
+    }
+    if (i == n) {
+        return NULL;
+    }
+    i++;
+    for (j = i; j < n && s[j] != '}'; j++) {
+    }
+    if (j == n) {
+        return NULL;
+    }
+    if (plen != NULL) {
+        *plen = j - i;
+    }
+    return s + i;
+}
+
+/*
+ * params s key, pcrc crc32 sum, phastag has tag
+ * return slot num
+ */
+int slots_num(const char* s, uint32_t* pcrc, int* phastag) {
+    int taglen;
+    int hastag = 0;
+    const char* tag = slots_tag(s, &taglen);
+    if (tag == NULL) {
+        tag = s, taglen = strlen(s);
+    } else {
+        hastag = 1;
+    }
+    uint32_t crc = crc32_checksum(tag, taglen);
+    if (pcrc != NULL) {
+        *pcrc = crc;
+    }
+    if (phastag != NULL) {
+        *phastag = hastag;
+    }
+    return crc & (g_slots_meta_info.hash_slots_size - 1);
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+#define LATENCY_SUB_COUNT (1 << SLOTS_LATENCY_SUB_BITS)
+#define LATENCY_MAX_VALUE ((1ULL << SLOTS_LATENCY_MAX_BITS) - 1)
+
+// per thread shard per op histogram, relaxed atomic add; threads more than
+// shards share one shard, so counters can't be plain add.
+typedef struct _slots_latency_shard {
+    uint64_t buckets[SLOTS_LATENCY_OP_NUM][SLOTS_LATENCY_BUCKETS];
+    uint64_t sum_ns[SLOTS_LATENCY_OP_NUM];
+} slots_latency_shard;
+
+static slots_latency_shard latency_shards[SLOTS_LATENCY_SHARDS];
+static int latency_shard_next = 0;
+static __thread int latency_shard_idx = -1;
+
+static const char* latency_op_names[SLOTS_LATENCY_OP_NUM] = {
+    "slots_add", "slots_del", "dump", "restore", "cron",
+};
+
+uint64_t SlotsLatency_NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+const char* SlotsLatency_OpName(slots_latency_op op) {
+    return latency_op_names[op];
+}
+
+// latencyBucketIndex
+// values < 2*SUB_COUNT are exact, then 2^SUB_BITS sub buckets per power of 2
+static inline int latencyBucketIndex(uint64_t ns) {
+    if (ns > LATENCY_MAX_VALUE)
+        ns = LATENCY_MAX_VALUE;
+    if (ns < LATENCY_SUB_COUNT)
+        return (int)ns;
+    int shift = 63 - __builtin_clzll(ns) - SLOTS_LATENCY_SUB_BITS;
+    return ((shift + 1) << SLOTS_LATENCY_SUB_BITS)
+           + (int)((ns >> shift) - LATENCY_SUB_COUNT);
+}
+
+// latencyBucketValue
+// return the highest value equivalent to the bucket
+static inline uint64_t latencyBucketValue(int idx) {
+    int shift = (idx >> SLOTS_LATENCY_SUB_BITS) - 1;
+    if (shift <= 0)
+        return (uint64_t)idx;
+    uint64_t sub
+        = (uint64_t)(idx & (LATENCY_SUB_COUNT - 1)) + LATENCY_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+static inline slots_latency_shard* latencyShard(void) {
+    if (latency_shard_idx < 0) {
+        latency_shard_idx
+            = __atomic_fetch_add(&latency_shard_next, 1, __ATOMIC_RELAXED)
+              % SLOTS_LATENCY_SHARDS;
+    }
+    return &latency_shards[latency_shard_idx];
+}
+
+void SlotsLatency_Add(slots_latency_op op, uint64_t ns) {
+    slots_latency_shard* shard = latencyShard();
+    __atomic_add_fetch(&shard->buckets[op][latencyBucketIndex(ns)], 1,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shard->sum_ns[op], ns, __ATOMIC_RELAXED);
+}
+
+// SlotsLatency_Summary
+// merge all shards for op, then walk the cumulative counts for percentiles
+void SlotsLatency_Summary(slots_latency_op op, slots_latency_summary* s) {
+    uint64_t merged[SLOTS_LATENCY_BUCKETS];
+    memset(s, 0, sizeof(*s));
+    memset(merged, 0, sizeof(merged));
+    for (int i = 0; i < SLOTS_LATENCY_SHARDS; i++) {
+        for (int j = 0; j < SLOTS_LATENCY_BUCKETS; j++) {
+            merged[j] += __atomic_load_n(&latency_shards[i].buckets[op][j],
+                                         __ATOMIC_RELAXED);
+        }
+        s->sum_ns
+            += __atomic_load_n(&latency_shards[i].sum_ns[op], __ATOMIC_RELAXED);
+    }
+    for (int j = 0; j < SLOTS_LATENCY_BUCKETS; j++) {
+        s->count += merged[j];
+    }
+    if (s->count == 0)
+        return;
+
+    // rank = ceil(p * count)
+    uint64_t p50_rank = (s->count * 500 + 999) / 1000;
+    uint64_t p99_rank = (s->count * 990 + 999) / 1000;
+    uint64_t p999_rank = (s->count * 999 + 999) / 1000;
+    uint64_t cum = 0;
+    for (int j = 0; j < SLOTS_LATENCY_BUCKETS; j++) {
+        if (merged[j] == 0)
+            continue;
+        uint64_t prev = cum;
+        cum += merged[j];
+        uint64_t v = latencyBucketValue(j);
+        if (prev < p50_rank && cum >= p50_rank)
+            s->p50_ns = v;
+        if (prev < p99_rank && cum >= p99_rank)
+            s->p99_ns = v;
+        if (prev < p999_rank && cum >= p999_rank)
+            s->p999_ns = v;
+        s->max_ns = v;
+    }
+}
+
+// SlotsLatency_Reset
+// concurrent adds while reset may be kept or lost, it's ok for stats
+void SlotsLatency_Reset(void) {
+    for (int i = 0; i < SLOTS_LATENCY_SHARDS; i++) {
+        for (int op = 0; op < SLOTS_LATENCY_OP_NUM; op++) {
+            for (int j = 0; j < SLOTS_LATENCY_BUCKETS; j++) {
+                __atomic_store_n(&latency_shards[i].buckets[op][j], 0,
+                                 __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&latency_shards[i].sum_ns[op], 0,
+                             __ATOMIC_RELAXED);
+        }
+    }
+}
@@ -38,6 +38,7 @@
 
 static int slotsRestoreCmd(RedisModuleCtx* ctx, RedisModuleString** argv,
                            int argc);
+static int slotsRestoreArgStride(RedisModuleString** argv);
 static int dispatchCmd(RedisModuleCtx* ctx, RedisModuleString** argv, int argc);
 
 /* Check if Redis version is compatible with the adapter. */
@@ -55,7 +56,12 @@ void* SlotsMGRTAsyncBlock_ThreadMain(void* arg) {
     SlotsMGRT_SetCpuAffinity(g_slots_meta_info.async_cpulist);
     bg_call_params* params = (bg_call_params*)arg;
     RedisModuleCtx* ctx = RedisModule_GetThreadSafeContext(params->bc);
+    // keys read from slot index are used without GIL, main thread may del
+    // them, hold the epoch so they are freed after used (mgrt copies the
+    // keys and leaves the epoch while dump/send/del)
+    SlotsEpoch_Enter();
     dispatchCmd(ctx, params->argv, params->argc);
+    SlotsEpoch_Exit();
     // Unblock client
     RedisModule_UnblockClient(params->bc, NULL);
     /* Free the arguments */
@@ -145,7 +151,8 @@ int SlotsRestoreAsyncBlock_RedisCommand(RedisModuleCtx* ctx,
                                         RedisModuleString** argv, int argc) {
     /* Make sure to async block a client when do slotsrestore cmd :) */
 
-    if (argc < 4 || (argc - 1) % 3 != 0)
+    int stride = slotsRestoreArgStride(argv);
+    if (argc < stride + 1 || (argc - 1) % stride != 0)
         return RedisModule_WrongArity(ctx);
 
     RedisModuleBlockedClient* bc = RedisModule_BlockClient(
@@ -196,6 +203,20 @@ int SlotsHashKey_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
     return REDISMODULE_OK;
 }
 
+// slotsBitmapWord
+// return bitmap word w masked with slot range [start, end)
+static inline uint64_t slotsBitmapWord(uint64_t* bitmap, long long w,
+                                       long long start, long long end) {
+    uint64_t bits = bitmap[w];
+    if (w == start >> 6) {
+        bits &= ~0ULL << (start & 63);
+    }
+    if (w == (end - 1) >> 6 && (end & 63) != 0) {
+        bits &= ~(~0ULL << (end & 63));
+    }
+    return bits;
+}
+
 /* *
  * slotsinfo [start] [count]
  * */
@@ -221,29 +242,145 @@ int SlotsInfo_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
         return REDISMODULE_ERR;
     }
 
-    int slots_slot[g_slots_meta_info.hash_slots_size];
-    int slots_size[g_slots_meta_info.hash_slots_size];
-    int n = 0;
     long long end = start + count;
+    if (start < 0) {
+        start = 0;
+    }
+    if (end > (long long)g_slots_meta_info.hash_slots_size) {
+        end = g_slots_meta_info.hash_slots_size;
+    }
+    // slot keys add/del from keyspace notify with GIL, bitmap is stable here,
+    // popcount for reply len, then walk the set bits to skip empty slots.
     int db = RedisModule_GetSelectedDb(ctx);
-    for (int i = start; i < end && i < (int)g_slots_meta_info.hash_slots_size;
-         i++) {
-        int s = dictSize(db_slot_infos[db].slotkey_tables[i]);
-        if (s == 0) {
-            continue;
+    uint32_t* counts = db_slot_infos[db].slot_key_counts;
+    uint64_t* bitmap = db_slot_infos[db].slot_bitmap;
+    long long n = 0;
+    for (long long w = start >> 6; start < end && w <= (end - 1) >> 6; w++) {
+        n += __builtin_popcountll(slotsBitmapWord(bitmap, w, start, end));
+    }
+    RedisModule_ReplyWithArray(ctx, n);
+    for (long long w = start >> 6; start < end && w <= (end - 1) >> 6; w++) {
+        uint64_t bits = slotsBitmapWord(bitmap, w, start, end);
+        while (bits != 0) {
+            int slot = (int)(w << 6) + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            RedisModule_ReplyWithArray(ctx, 2);
+            RedisModule_ReplyWithLongLong(ctx, slot);
+            RedisModule_ReplyWithLongLong(ctx, counts[slot]);
         }
-        slots_slot[n] = i;
-        slots_size[n] = s;
-        n++;
     }
 
-    RedisModule_ReplyWithArray(ctx, n);
-    for (int i = 0; i < n; i++) {
-        RedisModule_ReplyWithArray(ctx, 2);
-        RedisModule_ReplyWithLongLong(ctx, slots_slot[i]);
-        RedisModule_ReplyWithLongLong(ctx, slots_size[i]);
+    return REDISMODULE_OK;
+}
+
+/* *
+ * slotsmemory [start] [count] [samples n]
+ * slotsmemory bgscan
+ * slotsmemory full [start] [count]
+ * reply per non empty slot: slot keys bytes, default all slots;
+ * bytes is sampled keys avg MEMORY USAGE * keys (default 16 samples),
+ * at most 16384 / samples sampled slots per call (page by start),
+ * full reply the last bgscan (MEMORY USAGE all keys on a worker thread)
+ * result of current db.
+ * */
+int SlotsMemory_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                             int argc) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    int pos = 1;
+    int use_full = 0;
+    const uint64_t* full = NULL;
+    if (argc >= 2) {
+        const char* sub = RedisModule_StringPtrLen(argv[1], NULL);
+        if (strcasecmp(sub, "bgscan") == 0) {
+            if (argc != 2)
+                return RedisModule_WrongArity(ctx);
+            if (SlotsMemory_BGScan(ctx, db) != REDISMODULE_OK) {
+                RedisModule_ReplyWithError(
+                    ctx, "ERR slotsmemory bgscan already in progress");
+                return REDISMODULE_ERR;
+            }
+            RedisModule_ReplyWithSimpleString(ctx, "OK");
+            return REDISMODULE_OK;
+        }
+        if (strcasecmp(sub, "full") == 0) {
+            use_full = 1;
+            full = SlotsMemory_FullResult(db);
+            pos++;
+        }
     }
 
+    long long start = 0;
+    long long count = g_slots_meta_info.hash_slots_size;
+    long long samples = SLOTS_MEMORY_SAMPLES_DEFAULT;
+    int nums = 0;
+    for (; pos < argc; pos++) {
+        const char* arg = RedisModule_StringPtrLen(argv[pos], NULL);
+        if (!use_full && strcasecmp(arg, "samples") == 0 && pos + 1 < argc) {
+            pos++;
+            if (RedisModule_StringToLongLong(argv[pos], &samples)
+                    != REDISMODULE_OK
+                || samples <= 0 || samples > SLOTS_MEMORY_SAMPLES_MAX) {
+                RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+                return REDISMODULE_ERR;
+            }
+            continue;
+        }
+        long long v;
+        if (nums >= 2
+            || RedisModule_StringToLongLong(argv[pos], &v) != REDISMODULE_OK
+            || v < 0) {
+            RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        if (nums++ == 0) {
+            start = v;
+        } else {
+            count = v;
+        }
+    }
+    // clamp before start + count, don't overflow
+    long long size = g_slots_meta_info.hash_slots_size;
+    start = start > size ? size : start;
+    count = count > size ? size : count;
+    long long end = start + count;
+    if (end > size) {
+        end = size;
+    }
+    // sampled MEMORY USAGE calls on main thread, reply at most
+    // SLOTS_MEMORY_SAMPLE_CALLS_MAX / samples non empty slots per call,
+    // continue from the last replied slot + 1
+    long sampled_max = SLOTS_MEMORY_SAMPLE_CALLS_MAX / samples;
+    if (sampled_max < 1) {
+        sampled_max = 1;
+    }
+    // no bgscan full pass result yet
+    if (use_full && full == NULL) {
+        end = start;
+    }
+
+    uint32_t* counts = db_slot_infos[db].slot_key_counts;
+    uint64_t* bitmap = db_slot_infos[db].slot_bitmap;
+    long n = 0;
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    for (long long w = start >> 6; start < end && w <= (end - 1) >> 6; w++) {
+        uint64_t bits = slotsBitmapWord(bitmap, w, start, end);
+        while (bits != 0 && (use_full || n < sampled_max)) {
+            int slot = (int)(w << 6) + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            long long bytes = 0;
+            if (use_full) {
+                bytes = (long long)full[slot];
+            } else {
+                bytes = SlotsMemory_Sample(ctx, db, slot, (int)samples);
+            }
+            RedisModule_ReplyWithArray(ctx, 3);
+            RedisModule_ReplyWithLongLong(ctx, slot);
+            RedisModule_ReplyWithLongLong(ctx, counts[slot]);
+            RedisModule_ReplyWithLongLong(ctx, bytes);
+            n++;
+        }
+    }
+    RedisModule_ReplySetArrayLength(ctx, n);
     return REDISMODULE_OK;
 }
 
@@ -322,6 +459,8 @@ int SlotsMGRTSlot_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
 
 /* *
  * slotsmgrttagone host port timeout key
+ * with mgrt_batch_budget_us the tag keys are migrated in batches, not
+ * atomic: a batch err after some batches reply the migrated keys num.
  * */
 int SlotsMGRTTagOne_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
                                  int argc) {
@@ -353,8 +492,48 @@ int SlotsMGRTTagOne_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
     return REDISMODULE_OK;
 }
 
+/* *
+ * slotsmgrtconnect host port timeout [count]
+ * pre-connect count (default mgrt threads num, at least 1) PING checked conns
+ * to the target into the idle mgrt conns pool ahead of a rebalance,
+ * reply ready conns num
+ * */
+int SlotsMGRTConnect_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                                  int argc) {
+    if (argc != 4 && argc != 5)
+        return RedisModule_WrongArity(ctx);
+
+    const char* host = RedisModule_StringPtrLen(argv[1], NULL);
+    const char* port = RedisModule_StringPtrLen(argv[2], NULL);
+    long long timeout = 0;
+    if (RedisModule_StringToLongLong(argv[3], &timeout) != REDISMODULE_OK
+        || timeout < 0) {
+        RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+    long long count = g_slots_meta_info.slots_mgrt_threads > 0
+                          ? g_slots_meta_info.slots_mgrt_threads
+                          : 1;
+    if (argc == 5
+        && (RedisModule_StringToLongLong(argv[4], &count) != REDISMODULE_OK
+            || count <= 0 || count > MAX_NUM_THREADS)) {
+        RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    int r = SlotsMGRT_Connect(ctx, host, port, timeout, (int)count);
+    if (r == 0) {
+        RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_MGRT);
+        return REDISMODULE_ERR;
+    }
+    RedisModule_ReplyWithLongLong(ctx, r);
+    return REDISMODULE_OK;
+}
+
 /* *
  * slotsmgrttagslot host port timeout slot
+ * with mgrt_batch_budget_us the tag keys are migrated in batches, not
+ * atomic: a batch err after some batches reply the migrated keys num.
  * */
 int SlotsMGRTTagSlot_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
                                   int argc) {
@@ -451,25 +630,118 @@ int SlotsDel_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
     return REDISMODULE_OK;
 }
 
+// slotsrestore key ttl val, slotsrestorelzf key ttl rawlen val,
+// slotsrestorebin batch, slotsrestoreshm name offset len
+static int slotsRestoreArgStride(RedisModuleString** argv) {
+    const char* cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    if (strcasecmp(cmd, "slotsrestorebin") == 0) {
+        return 1;
+    }
+    return strcasecmp(cmd, "slotsrestorelzf") == 0 ? 4 : 3;
+}
+
+static int slotsRestoreBinCmd(RedisModuleCtx* ctx, RedisModuleString** argv,
+                              int argc) {
+    int ret = 0;
+    for (int i = 1; i < argc; i++) {
+        size_t len;
+        const char* buf = RedisModule_StringPtrLen(argv[i], &len);
+        int r = SlotsMGRT_RestoreBatch(ctx, buf, len);
+        if (r == SLOTS_MGRT_ERR) {
+            // the failed batch replicated its restored keys
+            return SLOTS_MGRT_ERR;
+        }
+        // replicate each restored batch to replicas/AOF in order, a later
+        // batch err keeps the batches before it on master
+        ASYNC_LOCK(ctx);
+        RedisModule_Replicate(ctx, "SLOTSRESTOREBIN", "s", argv[i]);
+        ASYNC_UNLOCK(ctx);
+        ret += r;
+    }
+    return ret;
+}
+
+static int slotsRestoreShmCmd(RedisModuleCtx* ctx, RedisModuleString** argv,
+                              int argc) {
+    int ret = 0;
+    for (int i = 1; i + 2 < argc; i += 3) {
+        const char* name = RedisModule_StringPtrLen(argv[i], NULL);
+        long long off = 0, len = 0;
+        if (RedisModule_StringToLongLong(argv[i + 1], &off) != REDISMODULE_OK
+            || RedisModule_StringToLongLong(argv[i + 2], &len)
+                   != REDISMODULE_OK) {
+            return SLOTS_MGRT_ERR;
+        }
+        void* map = NULL;
+        size_t maplen = 0;
+        const char* buf = SlotsShm_Map(name, off, len, &map, &maplen);
+        if (buf == NULL) {
+            RedisModule_Log(ctx, "warning",
+                            "slotsrestoreshm map %s offset %lld len %lld err",
+                            name, off, len);
+            MGRT_STATS_INCR(restore_errors, 1);
+            return SLOTS_MGRT_ERR;
+        }
+        int r = SlotsMGRT_RestoreBatch(ctx, buf, (size_t)len);
+        if (r != SLOTS_MGRT_ERR) {
+            // replicas/AOF can't map the source ring, replicate the batch
+            ASYNC_LOCK(ctx);
+            RedisModule_Replicate(ctx, "SLOTSRESTOREBIN", "b", buf,
+                                  (size_t)len);
+            ASYNC_UNLOCK(ctx);
+        }
+        SlotsShm_Unmap(map, maplen);
+        if (r == SLOTS_MGRT_ERR) {
+            return SLOTS_MGRT_ERR;
+        }
+        ret += r;
+    }
+    return ret;
+}
+
 static int slotsRestoreCmd(RedisModuleCtx* ctx, RedisModuleString** argv,
                            int argc) {
-    int n = (argc - 1) / 3;
+    const char* cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    if (strcasecmp(cmd, "slotsrestoreshm") == 0) {
+        return slotsRestoreShmCmd(ctx, argv, argc);
+    }
+    int stride = slotsRestoreArgStride(argv);
+    if (stride == 1) {
+        return slotsRestoreBinCmd(ctx, argv, argc);
+    }
+    int n = (argc - 1) / stride;
     int j = 0;
     rdb_dump_obj** objs = RedisModule_Alloc(sizeof(rdb_dump_obj*) * n);
     for (int i = 0; i < n; i++) {
+        RedisModuleString** args = argv + 1 + i * stride;
         // del -> add -> ttlms (>0)
         long long ttlms = 0;
         size_t ttllen;
-        const char* str_ttlms
-            = RedisModule_StringPtrLen(argv[i * 3 + 2], &ttllen);
+        const char* str_ttlms = RedisModule_StringPtrLen(args[1], &ttllen);
         if (!m_string2ll(str_ttlms, ttllen, &ttlms)) {
             FreeDumpObjs(ctx, objs, j);
             return SLOTS_MGRT_ERR;
         }
+        // 0: raw dump val, >0: lzf compressed, decompress when restore
+        long long rawlen = 0;
+        if (stride == 4
+            && (RedisModule_StringToLongLong(args[2], &rawlen)
+                    != REDISMODULE_OK
+                || rawlen < 0)) {
+            FreeDumpObjs(ctx, objs, j);
+            return SLOTS_MGRT_ERR;
+        }
+        size_t vsz;
+        RedisModule_StringPtrLen(args[stride - 1], &vsz);
+        if (!SlotsBatch_RawlenValid(vsz, (size_t)rawlen)) {
+            FreeDumpObjs(ctx, objs, j);
+            return SLOTS_MGRT_ERR;
+        }
         rdb_dump_obj* obj = RedisModule_Alloc(sizeof(rdb_dump_obj));
-        obj->key = argv[i * 3 + 1];
+        obj->key = args[0];
         obj->ttlms = (time_t)ttlms;
-        obj->val = takeAndRef(ctx, argv[i * 3 + 3]);
+        obj->val = takeAndRef(ctx, args[stride - 1]);
+        obj->rawlen = (size_t)rawlen;
         objs[j] = obj;
         j++;
     }
@@ -480,23 +752,46 @@ static int slotsRestoreCmd(RedisModuleCtx* ctx, RedisModuleString** argv,
         return SLOTS_MGRT_ERR;
     }
 
+    // inner RESTOREs are not propagated (a failed batch replicated its
+    // restored keys), replicate the whole batch as one slotsrestore(lzf)
+    ASYNC_LOCK(ctx);
+    RedisModule_Replicate(ctx, stride == 4 ? "SLOTSRESTORELZF" : "SLOTSRESTORE",
+                          "v", argv + 1, (size_t)(argc - 1));
+    ASYNC_UNLOCK(ctx);
+
     FreeDumpObjs(ctx, objs, j);
     return ret;
 }
 
 /* *
  * slotsrestore key ttl val [key ttl val ...]
+ * slotsrestorelzf key ttl rawlen val [key ttl rawlen val ...]
+ * rawlen 0: val is the raw dump payload, >0: lzf compressed dump payload
+ * slotsrestorebin batch [batch ...]
+ * batch: binary framed keys, ttls, types and (lzf) dump payloads with crc32
+ * slotsrestoreshm name offset len [name offset len ...]
+ * restore the batch at [offset, offset + len) of the co-located source
+ * /redisxslot-* shm ring, replicated as slotsrestorebin
  * */
 int SlotsRestore_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
                               int argc) {
-    if (g_slots_meta_info.async) {
+    // master/AOF/multi/lua client can't be blocked, restore inline
+    int flags = RedisModule_GetContextFlags(ctx);
+    int can_block
+        = !(flags
+            & (REDISMODULE_CTX_FLAGS_REPLICATED | REDISMODULE_CTX_FLAGS_LOADING
+               | REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA));
+    if (g_slots_meta_info.async && can_block) {
         return SlotsRestoreAsyncBlock_RedisCommand(ctx, argv, argc);
     }
 
-    if (argc < 4 || (argc - 1) % 3 != 0)
+    int stride = slotsRestoreArgStride(argv);
+    if (argc < stride + 1 || (argc - 1) % stride != 0)
         return RedisModule_WrongArity(ctx);
 
+    slots_async_inline = 1;
     int ret = slotsRestoreCmd(ctx, argv, argc);
+    slots_async_inline = 0;
     if (ret == SLOTS_MGRT_ERR) {
         RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_MGRT);
         return REDISMODULE_ERR;
@@ -601,12 +896,324 @@ static int dispatchCmd(RedisModuleCtx* ctx, RedisModuleString** argv,
  * use this func, must check whether add cmd handler in dispatchCmd */
 int SlotsDispatchRedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
                               int argc) {
+    // witheventloop mgrt, multi/lua client can't be blocked, mgrt sync
+    int flags = RedisModule_GetContextFlags(ctx);
+    int can_block
+        = !(flags & (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA));
+    if (argc == 6 && can_block
+        && (SlotsMGRT_ParseFlags(RedisModule_StringPtrLen(argv[5], NULL))
+            & SLOTS_MGRT_EVENTLOOP)) {
+        return SlotsMGRTLoop_RedisCommand(ctx, argv, argc);
+    }
     if (g_slots_meta_info.async) {
         return SlotsMGRTAsyncBlock_RedisCommand(ctx, argv, argc);
     }
     return dispatchCmd(ctx, argv, argc);
 }
 
+/*----------------------------- module options ---------------------------*/
+// named options after positional load args: name value [name value ...],
+// like this `--loadmodule ./redisxslot.so 1024 4 async mgrt_batch_budget_us
+// 10000`, runtime option can use `slotsconfig set name value` to change it.
+typedef struct _slots_option {
+    const char* name;
+    int* val;
+    int default_val;
+    long long min;
+    long long max;
+    // can change at runtime with slotsconfig set
+    int runtime;
+    // string option (val NULL) value, load only, point to module load argv
+    const char** str_val;
+} slots_option;
+
+static slots_option slots_options[] = {
+    {"mgrt_batch_budget_us", &g_slots_meta_info.mgrt_batch_budget_us, 0, 0,
+     MGRT_BATCH_BUDGET_US_MAX, 1, NULL},
+    {"latency_tracking", &g_slots_meta_info.latency_tracking, 0, 0, 1, 1,
+     NULL},
+    {"heat_halflife_sec", &g_slots_meta_info.heat_halflife_sec, 60, 1, 86400,
+     1, NULL},
+    {"heat_read_tracking", &g_slots_meta_info.heat_read_tracking, 0, 0, 1, 1,
+     NULL},
+    {"hotkeys_tracking", &g_slots_meta_info.hotkeys_tracking, 0, 0, 1, 1,
+     NULL},
+    {"bg_rehash", &g_slots_meta_info.bg_rehash, 0, 0, 1, 0, NULL},
+    {"lock_stripes", &g_slots_meta_info.lock_stripes,
+     SLOTS_LOCK_STRIPES_DEFAULT, 1, SLOTS_LOCK_STRIPES_MAX, 0, NULL},
+    {"mgrt_pipeline_window", &g_slots_meta_info.mgrt_pipeline_window,
+     MGRT_PIPELINE_WINDOW_DEFAULT, 1, MGRT_PIPELINE_WINDOW_MAX, 1, NULL},
+    {"mgrt_shm_ring_bytes", &g_slots_meta_info.mgrt_shm_ring_bytes,
+     MGRT_SHM_RING_BYTES_DEFAULT, MGRT_SHM_RING_BYTES_MIN,
+     MGRT_SHM_RING_BYTES_MAX, 1, NULL},
+    {"yield_keys", &g_slots_meta_info.yield_keys, SLOTS_YIELD_KEYS_DEFAULT, 0,
+     SLOTS_YIELD_MAX, 1, NULL},
+    {"yield_us", &g_slots_meta_info.yield_us, SLOTS_YIELD_US_DEFAULT, 0,
+     SLOTS_YIELD_MAX, 1, NULL},
+    {"bg_rehash_cpulist", NULL, 0, 0, 0, 0,
+     &g_slots_meta_info.bg_rehash_cpulist},
+    {NULL, NULL, 0, 0, 0, 0, NULL},
+};
+
+static slots_option* slotsOptionLookup(const char* name) {
+    for (slots_option* opt = slots_options; opt->name != NULL; opt++) {
+        if (strcasecmp(opt->name, name) == 0) {
+            return opt;
+        }
+    }
+    return NULL;
+}
+
+static void slotsOptionsSetDefault(void) {
+    for (slots_option* opt = slots_options; opt->name != NULL; opt++) {
+        if (opt->str_val != NULL) {
+            *opt->str_val = NULL;
+            continue;
+        }
+        *opt->val = opt->default_val;
+    }
+}
+
+// slotsOptionSet
+// value yes/no for bool option, return REDISMODULE_ERR if value invalid
+static int slotsOptionSet(slots_option* opt, RedisModuleString* val) {
+    long long v = 0;
+    const char* s = RedisModule_StringPtrLen(val, NULL);
+    if (opt->str_val != NULL) {
+        *opt->str_val = s;
+        return REDISMODULE_OK;
+    }
+    if (strcasecmp(s, "yes") == 0) {
+        v = 1;
+    } else if (strcasecmp(s, "no") == 0) {
+        v = 0;
+    } else if (RedisModule_StringToLongLong(val, &v) != REDISMODULE_OK) {
+        return REDISMODULE_ERR;
+    }
+    if (v < opt->min || v > opt->max) {
+        return REDISMODULE_ERR;
+    }
+    *opt->val = (int)v;
+    return REDISMODULE_OK;
+}
+
+// slotsOptionsLoad
+// return positional args num, named options start with the first option name
+static int slotsOptionsLoad(RedisModuleString** argv, int argc) {
+    int pos = 0;
+    while (pos < argc
+           && slotsOptionLookup(RedisModule_StringPtrLen(argv[pos], NULL))
+                  == NULL) {
+        pos++;
+    }
+    for (int i = pos; i < argc; i += 2) {
+        const char* name = RedisModule_StringPtrLen(argv[i], NULL);
+        slots_option* opt = slotsOptionLookup(name);
+        if (opt == NULL || i + 1 >= argc) {
+            printf("[ERROR] ModuleLoaded option %s syntax error\n", name);
+            return -1;
+        }
+        if (slotsOptionSet(opt, argv[i + 1]) != REDISMODULE_OK) {
+            printf("[ERROR] ModuleLoaded option %s value %s invalid\n", name,
+                   RedisModule_StringPtrLen(argv[i + 1], NULL));
+            return -1;
+        }
+    }
+    return pos;
+}
+
+/* *
+ * slotsconfig get pattern
+ * slotsconfig set name value
+ * */
+int SlotsConfig_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                             int argc) {
+    if (argc < 3)
+        return RedisModule_WrongArity(ctx);
+
+    const char* sub = RedisModule_StringPtrLen(argv[1], NULL);
+    if (strcasecmp(sub, "get") == 0 && argc == 3) {
+        size_t plen;
+        const char* pattern = RedisModule_StringPtrLen(argv[2], &plen);
+        long n = 0;
+        RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+        for (slots_option* opt = slots_options; opt->name != NULL; opt++) {
+            if (!m_stringmatchlen(pattern, (int)plen, opt->name,
+                                  (int)strlen(opt->name), 1)) {
+                continue;
+            }
+            RedisModule_ReplyWithSimpleString(ctx, opt->name);
+            if (opt->str_val != NULL) {
+                RedisModule_ReplyWithSimpleString(
+                    ctx, *opt->str_val != NULL ? *opt->str_val : "");
+            } else {
+                RedisModule_ReplyWithLongLong(ctx, *opt->val);
+            }
+            n += 2;
+        }
+        RedisModule_ReplySetArrayLength(ctx, n);
+        return REDISMODULE_OK;
+    }
+
+    if (strcasecmp(sub, "set") == 0 && argc == 4) {
+        slots_option* opt
+            = slotsOptionLookup(RedisModule_StringPtrLen(argv[2], NULL));
+        if (opt == NULL || !opt->runtime
+            || slotsOptionSet(opt, argv[3]) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+    return REDISMODULE_ERR;
+}
+
+/* *
+ * slotsstats [reset]
+ * hot path op latency (us) with latency_tracking yes,
+ * reply per op: name count avg p50 p99 p999 max
+ * */
+int SlotsStats_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                            int argc) {
+    if (argc > 2)
+        return RedisModule_WrongArity(ctx);
+
+    if (argc == 2) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[1], NULL), "reset")
+            != 0) {
+            RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        SlotsLatency_Reset();
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_ReplyWithArray(ctx, SLOTS_LATENCY_OP_NUM);
+    for (int op = 0; op < SLOTS_LATENCY_OP_NUM; op++) {
+        slots_latency_summary s;
+        SlotsLatency_Summary(op, &s);
+        RedisModule_ReplyWithArray(ctx, 13);
+        RedisModule_ReplyWithSimpleString(ctx, SlotsLatency_OpName(op));
+        RedisModule_ReplyWithSimpleString(ctx, "count");
+        RedisModule_ReplyWithLongLong(ctx, (long long)s.count);
+        RedisModule_ReplyWithSimpleString(ctx, "avg_us");
+        RedisModule_ReplyWithDouble(
+            ctx, s.count ? (double)s.sum_ns / s.count / 1000 : 0);
+        RedisModule_ReplyWithSimpleString(ctx, "p50_us");
+        RedisModule_ReplyWithDouble(ctx, (double)s.p50_ns / 1000);
+        RedisModule_ReplyWithSimpleString(ctx, "p99_us");
+        RedisModule_ReplyWithDouble(ctx, (double)s.p99_ns / 1000);
+        RedisModule_ReplyWithSimpleString(ctx, "p999_us");
+        RedisModule_ReplyWithDouble(ctx, (double)s.p999_ns / 1000);
+        RedisModule_ReplyWithSimpleString(ctx, "max_us");
+        RedisModule_ReplyWithDouble(ctx, (double)s.max_ns / 1000);
+    }
+    return REDISMODULE_OK;
+}
+
+/* *
+ * slotsheat [k] [writes|reads|all]
+ * slotsheat reset
+ * top k (default 10) hottest slots by decayed writes/reads/all,
+ * reads are counted with heat_read_tracking yes,
+ * reply per slot: slot writes reads
+ * */
+int SlotsHeat_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                           int argc) {
+    if (argc > 3)
+        return RedisModule_WrongArity(ctx);
+
+    if (argc == 2
+        && strcasecmp(RedisModule_StringPtrLen(argv[1], NULL), "reset")
+               == 0) {
+        SlotsHeat_Reset();
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        return REDISMODULE_OK;
+    }
+
+    long long k = 10;
+    if (argc >= 2) {
+        if (RedisModule_StringToLongLong(argv[1], &k) != REDISMODULE_OK
+            || k <= 0) {
+            RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        if (k > (long long)g_slots_meta_info.hash_slots_size) {
+            k = g_slots_meta_info.hash_slots_size;
+        }
+    }
+    int by = SLOTS_HEAT_BY_ALL;
+    if (argc == 3) {
+        const char* s = RedisModule_StringPtrLen(argv[2], NULL);
+        if (strcasecmp(s, "writes") == 0) {
+            by = SLOTS_HEAT_BY_WRITES;
+        } else if (strcasecmp(s, "reads") == 0) {
+            by = SLOTS_HEAT_BY_READS;
+        } else if (strcasecmp(s, "all") != 0) {
+            RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    int* slots = RedisModule_Alloc(sizeof(int) * k);
+    slot_heat* heats = RedisModule_Alloc(sizeof(slot_heat) * k);
+    int n = SlotsHeat_TopK((int)k, by, slots, heats);
+    RedisModule_ReplyWithArray(ctx, n);
+    for (int i = 0; i < n; i++) {
+        RedisModule_ReplyWithArray(ctx, 3);
+        RedisModule_ReplyWithLongLong(ctx, slots[i]);
+        RedisModule_ReplyWithLongLong(ctx, heats[i].writes);
+        RedisModule_ReplyWithLongLong(ctx, heats[i].reads);
+    }
+    RedisModule_Free(slots);
+    RedisModule_Free(heats);
+    return REDISMODULE_OK;
+}
+
+/* *
+ * slotshotkeys [slot]
+ * slotshotkeys reset
+ * current db hottest keys (of the slot) by estimated decayed writes,
+ * tracked with hotkeys_tracking yes,
+ * reply per key: key slot count
+ * */
+int SlotsHotKeys_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                              int argc) {
+    if (argc > 2)
+        return RedisModule_WrongArity(ctx);
+
+    int db = RedisModule_GetSelectedDb(ctx);
+    long long slot = -1;
+    if (argc == 2) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[1], NULL), "reset")
+            == 0) {
+            SlotsHotKeys_Reset(db);
+            RedisModule_ReplyWithSimpleString(ctx, "OK");
+            return REDISMODULE_OK;
+        }
+        if (RedisModule_StringToLongLong(argv[1], &slot) != REDISMODULE_OK
+            || slot < 0 || slot >= g_slots_meta_info.hash_slots_size) {
+            RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    slots_hotkey keys[SLOTS_HOTKEYS_TOPK];
+    int n = SlotsHotKeys_Get(db, (int)slot, keys);
+    RedisModule_ReplyWithArray(ctx, n);
+    for (int i = 0; i < n; i++) {
+        RedisModule_ReplyWithArray(ctx, 3);
+        RedisModule_ReplyWithString(ctx, keys[i].key);
+        RedisModule_ReplyWithLongLong(ctx, keys[i].slot);
+        RedisModule_ReplyWithLongLong(ctx, keys[i].count);
+    }
+    return REDISMODULE_OK;
+}
+
 static RedisModuleString* redisModule_GetConfigItem(RedisModuleCtx* ctx,
                                                     const char* name) {
     // config get databases
@@ -642,6 +1249,13 @@ static int redisModule_SlotsInit(RedisModuleCtx* ctx, RedisModuleString** argv,
     }
     RedisModule_FreeString(ctx, str);
 
+    // named options, the rest are positional args
+    slotsOptionsSetDefault();
+    argc = slotsOptionsLoad(argv, argc);
+    if (argc < 0) {
+        return REDISMODULE_ERR;
+    }
+
     // hash_solts_size
     long long hash_slots_size = DEFAULT_HASH_SLOTS_SIZE;
     if (argc >= 1
@@ -692,9 +1306,109 @@ static int redisModule_SlotsInit(RedisModuleCtx* ctx, RedisModuleString** argv,
 
     Slots_Init(ctx, hash_slots_size, databases, num_threads, activerehashing,
                async, async_cpulist);
+    SlotsHeat_Init(ctx);
+    SlotsHotKeys_Init();
+    if (g_slots_meta_info.bg_rehash && SlotsRehash_Start() != REDISMODULE_OK) {
+        printf("[ERROR] ModuleLoaded start bg rehash thread fail\n");
+        return REDISMODULE_ERR;
+    }
     return REDISMODULE_OK;
 }
 
+/*------------------------------ info handler -----------------------------*/
+static void infoAddLatencyHist(RedisModuleInfoCtx* ctx, const char* name,
+                               slots_latency_hist* hist) {
+    char field[32];
+    RedisModule_InfoBeginDictField(ctx, name);
+    for (int i = 0; i < MGRT_LATENCY_HIST_BUCKETS; i++) {
+        if (i == MGRT_LATENCY_HIST_BUCKETS - 1) {
+            snprintf(field, sizeof(field), "inf");
+        } else {
+            snprintf(field, sizeof(field), "le%llu", 1ULL << i);
+        }
+        RedisModule_InfoAddFieldULongLong(
+            ctx, field,
+            __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED));
+    }
+    RedisModule_InfoAddFieldULongLong(
+        ctx, "count", __atomic_load_n(&hist->count, __ATOMIC_RELAXED));
+    RedisModule_InfoAddFieldULongLong(
+        ctx, "sum", __atomic_load_n(&hist->sum_us, __ATOMIC_RELAXED));
+    RedisModule_InfoEndDictField(ctx);
+}
+
+// info redisxslot_mgrt / redisxslot_mgrtlatency
+// migrate health without parsing (per batch) logs
+void SlotsInfoFunc(RedisModuleInfoCtx* ctx, int for_crash_report) {
+    REDISMODULE_NOT_USED(for_crash_report);
+
+    RedisModule_InfoAddSection(ctx, "mgrt");
+    RedisModule_InfoAddFieldULongLong(ctx, "keys_migrated",
+                                      MGRT_STATS_GET(keys_migrated));
+    RedisModule_InfoAddFieldULongLong(ctx, "bytes_migrated",
+                                      MGRT_STATS_GET(bytes_migrated));
+    RedisModule_InfoAddFieldULongLong(ctx, "keys_deleted",
+                                      MGRT_STATS_GET(keys_deleted));
+    RedisModule_InfoAddFieldULongLong(ctx, "keys_restored",
+                                      MGRT_STATS_GET(keys_restored));
+    RedisModule_InfoAddFieldULongLong(ctx, "bytes_restored",
+                                      MGRT_STATS_GET(bytes_restored));
+    RedisModule_InfoAddFieldULongLong(ctx, "batches", MGRT_STATS_GET(batches));
+    RedisModule_InfoAddFieldULongLong(ctx, "inflight_batches",
+                                      MGRT_STATS_GET(inflight_batches));
+    RedisModule_InfoAddFieldULongLong(ctx, "compress_raw_bytes",
+                                      MGRT_STATS_GET(compress_raw_bytes));
+    RedisModule_InfoAddFieldULongLong(ctx, "compress_bytes",
+                                      MGRT_STATS_GET(compress_bytes));
+    RedisModule_InfoAddFieldULongLong(ctx, "shm_bytes",
+                                      MGRT_STATS_GET(shm_bytes));
+    int batch_keys;
+    size_t batch_bytes;
+    SlotsMGRT_GetBatchSize(&batch_keys, &batch_bytes);
+    RedisModule_InfoAddFieldLongLong(ctx, "batch_keys", batch_keys);
+    RedisModule_InfoAddFieldULongLong(ctx, "batch_bytes", batch_bytes);
+    RedisModule_InfoAddFieldLongLong(ctx, "async", g_slots_meta_info.async);
+    RedisModule_InfoAddFieldLongLong(ctx, "mgrt_threads",
+                                     g_slots_meta_info.slots_mgrt_threads);
+    RedisModule_InfoAddFieldLongLong(ctx, "dump_threads",
+                                     g_slots_meta_info.slots_dump_threads);
+    RedisModule_InfoAddFieldLongLong(ctx, "restore_threads",
+                                     g_slots_meta_info.slots_restore_threads);
+    RedisModule_InfoAddFieldULongLong(ctx, "conns_cached",
+                                      SlotsMGRT_CachedConnsNum());
+    RedisModule_InfoAddFieldULongLong(ctx, "eventloop_conns_cached",
+                                      SlotsMGRTLoop_ConnsNum());
+    RedisModule_InfoAddFieldULongLong(ctx, "epoch_retired_keys",
+                                      SlotsEpoch_RetiredKeys());
+    uint64_t slow_enters = 0;
+    RedisModule_InfoAddFieldLongLong(ctx, "epoch_slow_readers",
+                                     SlotsEpoch_SlowReaders(&slow_enters));
+    RedisModule_InfoAddFieldULongLong(ctx, "epoch_slow_enters", slow_enters);
+    RedisModule_InfoAddFieldULongLong(ctx, "conns_created",
+                                      MGRT_STATS_GET(conns_created));
+    RedisModule_InfoAddFieldULongLong(ctx, "conns_closed",
+                                      MGRT_STATS_GET(conns_closed));
+    RedisModule_InfoAddFieldULongLong(ctx, "conns_timedout",
+                                      MGRT_STATS_GET(conns_timedout));
+    RedisModule_InfoAddFieldULongLong(ctx, "dump_errors",
+                                      MGRT_STATS_GET(dump_errors));
+    RedisModule_InfoAddFieldULongLong(ctx, "send_errors",
+                                      MGRT_STATS_GET(send_errors));
+    RedisModule_InfoAddFieldULongLong(ctx, "del_errors",
+                                      MGRT_STATS_GET(del_errors));
+    RedisModule_InfoAddFieldULongLong(ctx, "restore_errors",
+                                      MGRT_STATS_GET(restore_errors));
+    RedisModule_InfoAddFieldULongLong(ctx, "conn_errors",
+                                      MGRT_STATS_GET(conn_errors));
+
+    RedisModule_InfoAddSection(ctx, "mgrtlatency");
+    infoAddLatencyHist(ctx, "dump_latency_us",
+                       &g_slots_mgrt_stats.dump_latency);
+    infoAddLatencyHist(ctx, "send_latency_us",
+                       &g_slots_mgrt_stats.send_latency);
+    infoAddLatencyHist(ctx, "del_latency_us", &g_slots_mgrt_stats.del_latency);
+}
+
 /*----------------------------- event handler  --------------------------*/
 int htNeedsResize(dict* dict) {
     long long size, used;
@@ -707,12 +1421,15 @@ int htNeedsResize(dict* dict) {
 /* If the percentage of used slots in the HT reaches HASHTABLE_MIN_FILL
  * we resize the hash table to save memory */
 void tryResizeDbSlotHashTables(RedisModuleCtx* ctx, int dbid, int slot) {
+    SLOTKEY_TABLE_WRLOCK(dbid, slot);
+    int r = DICT_ERR;
     if (htNeedsResize(db_slot_infos[dbid].slotkey_tables[slot])) {
-        if (m_dictResize(db_slot_infos[dbid].slotkey_tables[slot]) == DICT_OK) {
-            RedisModule_Log(ctx, "notice",
-                            "resizeDbSlotHashTables dbid %d slot %d", dbid,
-                            slot);
-        }
+        r = m_dictResize(db_slot_infos[dbid].slotkey_tables[slot]);
+    }
+    SLOTKEY_TABLE_UNLOCK(dbid, slot);
+    if (r == DICT_OK) {
+        RedisModule_Log(ctx, "notice", "resizeDbSlotHashTables dbid %d slot %d",
+                        dbid, slot);
     }
 }
 /* Our hash table implementation performs rehashing incrementally while
@@ -724,15 +1441,36 @@ void tryResizeDbSlotHashTables(RedisModuleCtx* ctx, int dbid, int slot) {
  * is returned. */
 int incrementallyDbSlotRehash(RedisModuleCtx* ctx, int dbid, int slot) {
     /* Keys dictionary */
-    if (dictIsRehashing(db_slot_infos[dbid].slotkey_tables[slot])) {
+    SLOTKEY_TABLE_WRLOCK(dbid, slot);
+    int rehashing = dictIsRehashing(db_slot_infos[dbid].slotkey_tables[slot]);
+    if (rehashing) {
+        m_dictRehashMilliseconds(db_slot_infos[dbid].slotkey_tables[slot], 1);
+    }
+    SLOTKEY_TABLE_UNLOCK(dbid, slot);
+    if (rehashing) {
         RedisModule_Log(ctx, "notice", "rehashDbSlotHashTables dbid %d slot %d",
                         dbid, slot);
-        m_dictRehashMilliseconds(db_slot_infos[dbid].slotkey_tables[slot], 1);
         return 1; /* already used our millisecond for this loop... */
     }
     return 0;
 }
 
+// like updateDictResizePolicy, don't resize (expand/shrink) slot dicts with
+// an active child (bgsave/aofrw), a new table touch all buckets, cow pages of
+// child; dicts still expand over the force resize ratio (5) of used/buckets
+static void updateSlotDictResizePolicy(int has_child) {
+    static int resize_disabled = 0;
+    if (has_child == resize_disabled) {
+        return;
+    }
+    resize_disabled = has_child;
+    if (has_child) {
+        m_dictDisableResize();
+    } else {
+        m_dictEnableResize();
+    }
+}
+
 void dbSlotCron(RedisModuleCtx* ctx) {
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
@@ -743,50 +1481,62 @@ void dbSlotCron(RedisModuleCtx* ctx) {
     /* We use global counters so if we stop the computation at a given
      * DB we'll be able to start from the successive in the next
      * cron loop iteration. */
-    static unsigned int resize_db = 0;
-    static unsigned int resize_db_slot = 0;
-    static unsigned int rehash_db = 0;
-    int dbs_per_call = CRON_DBS_PER_CALL;
+    // only visit the dirty slots marked by Slots_Add/Slots_Del (dict is
+    // rehashing or under HASHTABLE_MIN_FILL), at most
+    // CRON_DB_SLOTS_PER_CALL slots per call, resize all of them and
+    // rehash the first rehashing one for 1ms.
+    static int cron_db = 0;
+    static uint32_t cron_word = 0;
     int db_slots_per_call = CRON_DB_SLOTS_PER_CALL;
-    /* Don't test more dbs slots than we have. */
-    if (dbs_per_call > (int)g_slots_meta_info.databases)
-        dbs_per_call = g_slots_meta_info.databases;
-    if (db_slots_per_call > (int)g_slots_meta_info.hash_slots_size)
-        db_slots_per_call = g_slots_meta_info.hash_slots_size;
-
-    // ReSize try do db slot hash tables resize per call
-    for (int db = 0; db < dbs_per_call; db++) {
-        for (int slot = 0; slot < db_slots_per_call; slot++) {
-            tryResizeDbSlotHashTables(ctx, resize_db, resize_db_slot);
-            resize_db_slot++;
-            resize_db_slot %= g_slots_meta_info.hash_slots_size;
-        }
-        resize_db++;
-        resize_db %= g_slots_meta_info.databases;
-    }  // end for
+    uint32_t words = SLOTS_BITMAP_WORDS(g_slots_meta_info.hash_slots_size);
 
     int flag = RedisModule_GetContextFlags(ctx);
-    if (!g_slots_meta_info.activerehashing
-        || (flag & REDISMODULE_CTX_FLAGS_ACTIVE_CHILD)) {
-        return;
-    }
-
-    // ReHash just try do one db slot hash table rehash
-    for (int db = 0; db < g_slots_meta_info.databases; db++) {
-        for (int slot = 0; slot < (int)g_slots_meta_info.hash_slots_size;
-             slot++) {
-            int work_done = incrementallyDbSlotRehash(ctx, rehash_db, slot);
-            if (work_done) {
-                /* If the function did some work, stop here, we'll do
-                 * more at the next cron loop. */
-                return;
-            } else {
-                /* If this db didn't need rehash, we'll try the next one. */
-                rehash_db++;
-                rehash_db %= g_slots_meta_info.databases;
+    updateSlotDictResizePolicy((flag & REDISMODULE_CTX_FLAGS_ACTIVE_CHILD)
+                               != 0);
+    int can_rehash = g_slots_meta_info.activerehashing
+                     && !(flag & REDISMODULE_CTX_FLAGS_ACTIVE_CHILD);
+    // bg rehash thread do the rehash steps, cron just resize
+    if (SlotsRehash_Running()) {
+        SlotsRehash_SetPaused(!can_rehash);
+        can_rehash = 0;
+    }
+    int work_done = 0;
+
+    for (int dbs = 0; dbs <= g_slots_meta_info.databases; dbs++) {
+        if (__atomic_load_n(&db_slot_infos[cron_db].slot_dirty_num,
+                            __ATOMIC_RELAXED)
+            == 0) {
+            cron_db = (cron_db + 1) % g_slots_meta_info.databases;
+            cron_word = 0;
+            continue;
+        }
+        uint64_t* dirty = db_slot_infos[cron_db].slot_dirty_bitmap;
+        for (; cron_word < words; cron_word++) {
+            uint64_t bits
+                = __atomic_load_n(&dirty[cron_word], __ATOMIC_RELAXED);
+            while (bits) {
+                if (db_slots_per_call-- == 0) {
+                    /* resume from this word in the next cron loop */
+                    return;
+                }
+                int slot = (int)(cron_word << 6) + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                tryResizeDbSlotHashTables(ctx, cron_db, slot);
+                if (can_rehash && !work_done) {
+                    work_done = incrementallyDbSlotRehash(ctx, cron_db, slot);
+                }
+                dict* d = db_slot_infos[cron_db].slotkey_tables[slot];
+                SLOTKEY_TABLE_RDLOCK(cron_db, slot);
+                int done = !dictIsRehashing(d) && !htNeedsResize(d);
+                SLOTKEY_TABLE_UNLOCK(cron_db, slot);
+                if (done) {
+                    Slots_ClearDirty(cron_db, slot);
+                }
             }
         }
-    }  // end for
+        cron_db = (cron_db + 1) % g_slots_meta_info.databases;
+        cron_word = 0;
+    }
 }
 
 // serverCron --> databasesCron --> resize,rehash
@@ -801,9 +1551,15 @@ void CronLoopCallback(RedisModuleCtx* ctx, RedisModuleEvent e, uint64_t sub,
     RedisModule_AutoMemory(ctx);
 
     RedisModuleCronLoop* ei = data;
+    SLOTS_LATENCY_BEGIN(start);
     dbSlotCron(ctx);
+    SLOTS_LATENCY_END(SLOTS_LATENCY_OP_CRON, start);
+    SlotsHeat_Cron();
+    SlotsHotKeys_Cron();
+    SlotsEpoch_Cron();
     run_with_period(1000, ei->hz) {
         SlotsMGRT_CloseTimedoutConns(ctx);
+        SlotsMGRTLoop_CloseTimedoutConns(ctx);
     }
 
     g_slots_meta_info.cronloops++;
@@ -835,8 +1591,12 @@ void FlushdbCallback(RedisModuleCtx* ctx, RedisModuleEvent e, uint64_t sub,
             if (dictSize(db_slot_infos[db].slotkey_tables[slot]) == 0) {
                 continue;
             }
+            SLOTKEY_TABLE_WRLOCK(db, slot);
             m_dictEmpty(db_slot_infos[db].slotkey_tables[slot], NULL);
+            SLOTKEY_TABLE_UNLOCK(db, slot);
         }
+        Slots_ResetKeyCounts(db);
+        SlotsHotKeys_Reset(db);
         if (db_slot_infos[db].tagged_key_list->length != 0) {
             m_zslFree(db_slot_infos[db].tagged_key_list);
             db_slot_infos[db].tagged_key_list = m_zslCreate();
@@ -849,15 +1609,38 @@ void FlushdbCallback(RedisModuleCtx* ctx, RedisModuleEvent e, uint64_t sub,
             if (dictSize(db_slot_infos[db].slotkey_tables[slot]) == 0) {
                 continue;
             }
+            SLOTKEY_TABLE_WRLOCK(db, slot);
             m_dictEmpty(db_slot_infos[db].slotkey_tables[slot], NULL);
+            SLOTKEY_TABLE_UNLOCK(db, slot);
         }
+        Slots_ResetKeyCounts(db);
         if (db_slot_infos[db].tagged_key_list->length != 0) {
             m_zslFree(db_slot_infos[db].tagged_key_list);
             db_slot_infos[db].tagged_key_list = m_zslCreate();
         }
     }
+    SlotsHotKeys_Reset(-1);
 }
 
+#ifdef REDISMODULE_SUBEVENT_FORK_CHILD_BORN
+// fork child born/died (rdb save, aof rewrite, module fork) in parent
+// moduleFireServerEvent REDISMODULE_EVENT_FORK_CHILD, redis 6.2+,
+// the cron check active child flag for redis 6.0
+void ForkChildCallback(RedisModuleCtx* ctx, RedisModuleEvent e, uint64_t sub,
+                       void* data) {
+    REDISMODULE_NOT_USED(e);
+    REDISMODULE_NOT_USED(data);
+    RedisModule_Log(ctx, "verbose", "ForkChildCallback module-event-%s",
+                    sub == REDISMODULE_SUBEVENT_FORK_CHILD_BORN ? "born"
+                                                                : "died");
+    int born = sub == REDISMODULE_SUBEVENT_FORK_CHILD_BORN;
+    updateSlotDictResizePolicy(born);
+    // pause the bg rehasher now, not at the next cron, rehash steps cow the
+    // child pages; the cron sets it again after the child exits
+    SlotsRehash_SetPaused(born || !g_slots_meta_info.activerehashing);
+}
+#endif
+
 // showtdown cmd -> prepareForShutdown -> finishShutdown
 // -> Fire the shutdown modules event REDISMODULE_EVENT_SHUTDOWN
 void ShutdownCallback(RedisModuleCtx* ctx, RedisModuleEvent e, uint64_t sub,
@@ -868,7 +1651,11 @@ void ShutdownCallback(RedisModuleCtx* ctx, RedisModuleEvent e, uint64_t sub,
 
     RedisModule_Log(ctx, "notice", "ShutdownCallback module-event-%s",
                     "shutdown");
+    SlotsMGRTLoop_Free();
+    SlotsMemory_Free(ctx);
     Slots_Free(ctx);
+    SlotsHeat_Free(ctx);
+    SlotsHotKeys_Free();
 }
 
 /*------------------------------ notify handler --------------------------*/
@@ -881,7 +1668,12 @@ int NotifyTypeChangeCallback(RedisModuleCtx* ctx, int type, const char* event,
                     "NotifyTypeChangeCallback db %d event type %d, "
                     "event %s, key %s",
                     db, type, event, RedisModule_StringPtrLen(key, NULL));
-    Slots_Add(ctx, db, key);
+    int slot = Slots_Add(ctx, db, key);
+    // rdb/aof loaded keys are not writes
+    if (strcmp(event, "loaded") != 0) {
+        SlotsHeat_Write(slot);
+        SlotsHotKeys_Touch(db, slot, key);
+    }
     return REDISMODULE_OK;
 }
 
@@ -894,8 +1686,14 @@ int NotifyGenericCallback(RedisModuleCtx* ctx, int type, const char* event,
         "NotifyGenericCallback db %d event type %d, event %s, key %s", dbid,
         type, event, RedisModule_StringPtrLen(key, NULL));
 
-    if (strcmp(event, "del") == 0 || strcmp(event, "expired") == 0) {
+    if (strcmp(event, "del") == 0) {
+        SlotsHeat_Write(Slots_Del(ctx, dbid, key));
+        SlotsHotKeys_Del(dbid, key);
+        return REDISMODULE_OK;
+    }
+    if (strcmp(event, "expired") == 0) {
         Slots_Del(ctx, dbid, key);
+        SlotsHotKeys_Del(dbid, key);
         return REDISMODULE_OK;
     }
 
@@ -940,7 +1738,10 @@ int NotifyGenericCallback(RedisModuleCtx* ctx, int type, const char* event,
     }
 
     Slots_Del(ctx, local_from_dbid, local_from_key);
-    Slots_Add(ctx, local_to_dbid, local_to_key);
+    SlotsHotKeys_Del(local_from_dbid, local_from_key);
+    int slot = Slots_Add(ctx, local_to_dbid, local_to_key);
+    SlotsHeat_Write(slot);
+    SlotsHotKeys_Touch(local_to_dbid, slot, local_to_key);
 
     /* Release sources. */
     if (cmd_flag == CMD_RENAME) {
@@ -992,12 +1793,18 @@ RedisModule_OnLoad(RedisModuleCtx* ctx, RedisModuleString** argv, int argc) {
         return REDISMODULE_ERR;
     }
 
+    RedisModule_RegisterInfoFunc(ctx, SlotsInfoFunc);
+
     RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_CronLoop,
                                        CronLoopCallback);
     RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_FlushDB,
                                        FlushdbCallback);
     RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_Shutdown,
                                        ShutdownCallback);
+#ifdef REDISMODULE_SUBEVENT_FORK_CHILD_BORN
+    RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_ForkChild,
+                                       ForkChildCallback);
+#endif
 
     RedisModule_SubscribeToKeyspaceEvents(
         ctx,
@@ -1008,16 +1815,28 @@ RedisModule_OnLoad(RedisModuleCtx* ctx, RedisModuleString** argv, int argc) {
     RedisModule_SubscribeToKeyspaceEvents(
         ctx, REDISMODULE_NOTIFY_GENERIC | REDISMODULE_NOTIFY_EXPIRED,
         NotifyGenericCallback);
+    RedisModule_RegisterCommandFilter(ctx, SlotsHeat_CommandFilter,
+                                      REDISMODULE_CMDFILTER_NOSELF);
 
     CREATE_ROMCMD("slotshashkey", SlotsHashKey_RedisCommand, 0, 0, 0);
     CREATE_ROMCMD("slotsinfo", SlotsInfo_RedisCommand, 0, 0, 0);
+    CREATE_ROMCMD("slotsheat", SlotsHeat_RedisCommand, 0, 0, 0);
+    CREATE_ROMCMD("slotshotkeys", SlotsHotKeys_RedisCommand, 0, 0, 0);
+    CREATE_ROMCMD("slotsmemory", SlotsMemory_RedisCommand, 0, 0, 0);
     CREATE_ROMCMD("slotsscan", SlotsScan_RedisCommand, 0, 0, 0);
+    CREATE_CMD("slotsconfig", SlotsConfig_RedisCommand, "admin", 0, 0, 0);
+    CREATE_CMD("slotsstats", SlotsStats_RedisCommand, "admin", 0, 0, 0);
 
     CREATE_WRMCMD("slotsmgrtone", SlotsDispatchRedisCommand, 0, 0, 0);
     CREATE_WRMCMD("slotsmgrtslot", SlotsDispatchRedisCommand, 0, 0, 0);
     CREATE_WRMCMD("slotsmgrttagone", SlotsDispatchRedisCommand, 0, 0, 0);
     CREATE_WRMCMD("slotsmgrttagslot", SlotsDispatchRedisCommand, 0, 0, 0);
+    CREATE_CMD("slotsmgrtconnect", SlotsMGRTConnect_RedisCommand, "admin", 0,
+               0, 0);
     CREATE_WRMCMD("slotsrestore", SlotsRestore_RedisCommand, 0, 0, 0);
+    CREATE_WRMCMD("slotsrestorelzf", SlotsRestore_RedisCommand, 0, 0, 0);
+    CREATE_WRMCMD("slotsrestorebin", SlotsRestore_RedisCommand, 0, 0, 0);
+    CREATE_WRMCMD("slotsrestoreshm", SlotsRestore_RedisCommand, 0, 0, 0);
     CREATE_WRMCMD("slotsdel", SlotsDispatchRedisCommand, 0, 0, 0);
     // CREATE_WRMCMD("slotstest", SlotsDispatchRedisCommand, 0, 0, 0);
 
@@ -1025,6 +1844,10 @@ RedisModule_OnLoad(RedisModuleCtx* ctx, RedisModuleString** argv, int argc) {
 }
 
 int RedisModule_OnUnload(RedisModuleCtx* ctx) {
+    SlotsMGRTLoop_Free();
+    SlotsMemory_Free(ctx);
     Slots_Free(ctx);
+    SlotsHeat_Free(ctx);
+    SlotsHotKeys_Free();
     return REDISMODULE_OK;
 }
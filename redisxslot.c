@@ -30,60 +30,32 @@
 
 slots_meta_info g_slots_meta_info;
 db_slot_info* db_slot_infos;
+slots_rwlock_stripe* slots_lock_stripes;
+slots_mgrt_stats g_slots_mgrt_stats;
+__thread int slots_async_inline = 0;
+// main thread is in RedisModule_Yield, see SlotsYield_Keys
+int slots_yielding = 0;
 
 // declare defined static var to inner use (private prototypes)
+// slots_lock_stripes alloc ptr, stripes are aligned to cache line in it
+static void* slots_lock_stripes_alloc;
+// idle mgrt conns pool, {target} -> idle conns list (conn->next, most
+// recently used first), a conn is taken out of the pool while it's used
 static RedisModuleDict* slotsmgrt_cached_ctx_connects;
+static uint64_t slotsmgrt_cached_ctx_connects_num = 0;
 static pthread_mutex_t slotsmgrt_cached_ctx_connects_lock
     = PTHREAD_MUTEX_INITIALIZER;
+// adaptive mgrt batch size, shared by all mgrt clients (async block threads)
+static mgrt_batch_ctrl slotsmgrt_batch_ctrl
+    = {.lock = PTHREAD_MUTEX_INITIALIZER,
+       .batch_keys = MGRT_BATCH_KEYS_INIT,
+       .batch_bytes = REDIS_MGRT_CMD_PARAMS_SIZE};
 // rm_call big locker, need change redis struct to support multi threads :|
 // so (*mgrt*)/restore job should async block run,
 // splite batch todo, don't or less block other cmd run :)
 // if change redis struct, use RedisModule_ThreadSafeContextLock GIL instead it.
 // static pthread_mutex_t rm_call_lock = PTHREAD_MUTEX_INITIALIZER;
-
-// declare static function to inner use (private prototypes)
-static const char* slots_tag(const char* s, int* plen);
-
-uint64_t dictModuleStrHash(const void* key) {
-    size_t len;
-    const char* buf = RedisModule_StringPtrLen(key, &len);
-    return m_dictGenHashFunction(buf, (int)len);
-}
-
-int dictModuleStrKeyCompare(void* privdata, const void* key1,
-                            const void* key2) {
-    size_t l1, l2;
-    DICT_NOTUSED(privdata);
-
-    const char* buf1 = RedisModule_StringPtrLen(key1, &l1);
-    const char* buf2 = RedisModule_StringPtrLen(key2, &l2);
-    if (l1 != l2)
-        return 0;
-    return memcmp(buf1, buf2, l1) == 0;
-}
-
-void dictModuleKeyDestructor(void* privdata, void* val) {
-    DICT_NOTUSED(privdata);
-    if (val) {
-        RedisModule_FreeString(NULL, val);
-    }
-}
-
-void dictModuleValueDestructor(void* privdata, void* val) {
-    DICT_NOTUSED(privdata);
-    if (val) {
-        RedisModule_FreeString(NULL, val);
-    }
-}
-
-m_dictType hashSlotDictType = {
-    dictModuleStrHash,        /* hash function */
-    NULL,                     /* key dup */
-    NULL,                     /* val dup */
-    dictModuleStrKeyCompare,  /* key compare */
-    dictModuleKeyDestructor,  /* key destructor */
-    dictModuleValueDestructor /* val destructor */
-};
+static void freeMgrtConn(db_slot_mgrt_connect* conn);
 
 void Slots_Init(RedisModuleCtx* ctx, uint32_t hash_slots_size, int databases,
                 int num_threads, int activerehashing, int async,
@@ -96,6 +68,15 @@ void Slots_Init(RedisModuleCtx* ctx, uint32_t hash_slots_size, int databases,
     g_slots_meta_info.async_cpulist = async_cpulist;
     g_slots_meta_info.activerehashing = activerehashing;
     g_slots_meta_info.cronloops = 0;
+    // only main thread (or GIL holders) touch the slot index without thread
+    // pool, async block and bg rehash, index ops skip the locks and atomics
+    g_slots_meta_info.slot_locking
+        = num_threads > 0 || async || g_slots_meta_info.bg_rehash;
+
+    pthread_mutex_lock(&slotsmgrt_batch_ctrl.lock);
+    slotsmgrt_batch_ctrl.batch_keys = MGRT_BATCH_KEYS_INIT;
+    slotsmgrt_batch_ctrl.batch_bytes = REDIS_MGRT_CMD_PARAMS_SIZE;
+    pthread_mutex_unlock(&slotsmgrt_batch_ctrl.lock);
 
     // worker thread pool for each indepence task, less mutex case.
     // if more mutex, maybe don't use it. want to learn, open it :)
@@ -106,18 +87,37 @@ void Slots_Init(RedisModuleCtx* ctx, uint32_t hash_slots_size, int databases,
     /* like bio define diff type job thread, just one type job thread todo. no
      * mutex, but no wait, so use async job, such as async net/disk io */
 
+    // fixed striped rwlocks instead of databases * hash_slots_size locks
+    int stripes = 1;
+    while (stripes < g_slots_meta_info.lock_stripes) {
+        stripes <<= 1;
+    }
+    g_slots_meta_info.lock_stripes = stripes;
+    slots_lock_stripes_alloc = RedisModule_Alloc(
+        sizeof(slots_rwlock_stripe) * stripes + SLOTS_CACHE_LINE_SIZE - 1);
+    slots_lock_stripes
+        = (slots_rwlock_stripe*)(((uintptr_t)slots_lock_stripes_alloc
+                                  + SLOTS_CACHE_LINE_SIZE - 1)
+                                 & ~(uintptr_t)(SLOTS_CACHE_LINE_SIZE - 1));
+    for (int i = 0; i < stripes; i++) {
+        pthread_rwlock_init(&slots_lock_stripes[i].lock, NULL);
+    }
+
     db_slot_infos = RedisModule_Alloc(sizeof(db_slot_info) * databases);
     for (int j = 0; j < databases; j++) {
         db_slot_infos[j].slotkey_tables
             = RedisModule_Alloc(sizeof(dict*) * hash_slots_size);
-        db_slot_infos[j].slotkey_table_rwlocks
-            = RedisModule_Alloc(sizeof(pthread_rwlock_t) * hash_slots_size);
         for (uint32_t i = 0; i < hash_slots_size; i++) {
             db_slot_infos[j].slotkey_tables[i]
                 = m_dictCreate(&hashSlotDictType, NULL);
-            pthread_rwlock_init(&(db_slot_infos[j].slotkey_table_rwlocks[i]),
-                                NULL);
         }
+        db_slot_infos[j].slot_key_counts
+            = RedisModule_Calloc(hash_slots_size, sizeof(uint32_t));
+        db_slot_infos[j].slot_bitmap = RedisModule_Calloc(
+            SLOTS_BITMAP_WORDS(hash_slots_size), sizeof(uint64_t));
+        db_slot_infos[j].slot_dirty_bitmap = RedisModule_Calloc(
+            SLOTS_BITMAP_WORDS(hash_slots_size), sizeof(uint64_t));
+        db_slot_infos[j].slot_dirty_num = 0;
         db_slot_infos[j].slotkey_table_rehashing = 0;
         db_slot_infos[j].tagged_key_list = m_zslCreate();
         pthread_rwlock_init(&(db_slot_infos[j].tagged_key_list_rwlock), NULL);
@@ -128,26 +128,27 @@ void Slots_Init(RedisModuleCtx* ctx, uint32_t hash_slots_size, int databases,
 
 void Slots_Free(RedisModuleCtx* ctx) {
     RedisModule_Log(ctx, "notice", "slots free");
+    SlotsRehash_Stop();
     for (int j = 0; j < g_slots_meta_info.databases; j++) {
         if (db_slot_infos != NULL && db_slot_infos[j].slotkey_tables != NULL) {
             for (uint32_t i = 0; i < g_slots_meta_info.hash_slots_size; i++) {
-                pthread_rwlock_wrlock(
-                    &(db_slot_infos[j].slotkey_table_rwlocks[i]));
+                SLOTKEY_TABLE_WRLOCK(j, i);
                 m_dictRelease(db_slot_infos[j].slotkey_tables[i]);
-                pthread_rwlock_unlock(
-                    &(db_slot_infos[j].slotkey_table_rwlocks[i]));
-                pthread_rwlock_destroy(
-                    &(db_slot_infos[j].slotkey_table_rwlocks[i]));
+                SLOTKEY_TABLE_UNLOCK(j, i);
             }
             RedisModule_Free(db_slot_infos[j].slotkey_tables);
             db_slot_infos[j].slotkey_tables = NULL;
-            RedisModule_Free(db_slot_infos[j].slotkey_table_rwlocks);
-            db_slot_infos[j].slotkey_table_rwlocks = NULL;
+            RedisModule_Free(db_slot_infos[j].slot_key_counts);
+            db_slot_infos[j].slot_key_counts = NULL;
+            RedisModule_Free(db_slot_infos[j].slot_bitmap);
+            db_slot_infos[j].slot_bitmap = NULL;
+            RedisModule_Free(db_slot_infos[j].slot_dirty_bitmap);
+            db_slot_infos[j].slot_dirty_bitmap = NULL;
         }
         if (db_slot_infos != NULL && db_slot_infos[j].tagged_key_list != NULL) {
-            pthread_rwlock_wrlock(&(db_slot_infos[j].tagged_key_list_rwlock));
+            TAGGED_KEY_LIST_WRLOCK(j);
             m_zslFree(db_slot_infos[j].tagged_key_list);
-            pthread_rwlock_unlock(&(db_slot_infos[j].tagged_key_list_rwlock));
+            TAGGED_KEY_LIST_UNLOCK(j);
             db_slot_infos[j].tagged_key_list = NULL;
             pthread_rwlock_destroy(&(db_slot_infos[j].tagged_key_list_rwlock));
         }
@@ -156,58 +157,33 @@ void Slots_Free(RedisModuleCtx* ctx) {
         RedisModule_Free(db_slot_infos);
         db_slot_infos = NULL;
     }
+    SlotsEpoch_Free();
+    if (slots_lock_stripes != NULL) {
+        for (int i = 0; i < g_slots_meta_info.lock_stripes; i++) {
+            pthread_rwlock_destroy(&slots_lock_stripes[i].lock);
+        }
+        RedisModule_Free(slots_lock_stripes_alloc);
+        slots_lock_stripes_alloc = NULL;
+        slots_lock_stripes = NULL;
+    }
     if (slotsmgrt_cached_ctx_connects != NULL) {
+        RedisModuleDictIter* di = RedisModule_DictIteratorStartC(
+            slotsmgrt_cached_ctx_connects, "^", NULL, 0);
+        db_slot_mgrt_connect* conn;
+        while (RedisModule_DictNextC(di, NULL, (void**)&conn)) {
+            while (conn != NULL) {
+                db_slot_mgrt_connect* next = conn->next;
+                freeMgrtConn(conn);
+                conn = next;
+            }
+        }
+        RedisModule_DictIteratorStop(di);
+        slotsmgrt_cached_ctx_connects_num = 0;
         RedisModule_FreeDict(ctx, slotsmgrt_cached_ctx_connects);
         slotsmgrt_cached_ctx_connects = NULL;
     }
 }
 
-/*
- * params s key, pcrc crc32 sum, phastag has tag
- * return slot num
- */
-int slots_num(const char* s, uint32_t* pcrc, int* phastag) {
-    int taglen;
-    int hastag = 0;
-    const char* tag = slots_tag(s, &taglen);
-    if (tag == NULL) {
-        tag = s, taglen = strlen(s);
-    } else {
-        hastag = 1;
-    }
-    uint32_t crc = crc32_checksum(tag, taglen);
-    if (pcrc != NULL) {
-        *pcrc = crc;
-    }
-    if (phastag != NULL) {
-        *phastag = hastag;
-    }
-    return crc & (g_slots_meta_info.hash_slots_size - 1);
-}
-
-/*
- * params s key, plen tag len
- * return tag start pos char *
- */
-static const char* slots_tag(const char* s, int* plen) {
-    int i, j, n = strlen(s);
-    for (i = 0; i < n && s[i] != '{'; i++) {
-    }
-    if (i == n) {
-        return NULL;
-    }
-    i++;
-    for (j = i; j < n && s[j] != '}'; j++) {
-    }
-    if (j == n) {
-        return NULL;
-    }
-    if (plen != NULL) {
-        *plen = j - i;
-    }
-    return s + i;
-}
-
 static time_t get_unixtime(void) {
 #if (REDIS_VERSION == 70200)
     return (time_t)(RedisModule_CachedMicroseconds() / 1e6);
@@ -215,149 +191,309 @@ static time_t get_unixtime(void) {
     return (time_t)(RedisModule_Milliseconds() / 1e3);
 }
 
-static long long getTid() {
-#ifdef __APPLE__
-    __uint64_t tid;
-    pthread_threadid_np(NULL, &tid);
-    return (long long)tid;
-#else
-    return (long long)syscall(__NR_gettid);
-#endif
+// SlotsMGRT_UnixPath
+// mgrt target host like `/path/to/redis.sock` or `unix:/path/to/redis.sock`
+// is a unix socket (port is ignored), return the socket path, tcp return NULL
+const char* SlotsMGRT_UnixPath(const char* host) {
+    size_t plen = strlen(SLOTS_MGRT_UNIX_PREFIX);
+    if (strncmp(host, SLOTS_MGRT_UNIX_PREFIX, plen) == 0) {
+        return host + plen;
+    }
+    return host[0] == '/' ? host : NULL;
 }
 
-// getConnName
-// return {host}:{port}@{thread_id}
-static sds getConnName(const sds host, const sds port) {
+// SlotsMGRT_TargetName
+// return unix:{path} or {host}:{port}, conns cache key of the target
+sds SlotsMGRT_TargetName(const char* host, const char* port) {
     sds name = sdsempty();
-    name = sdscatlen(name, host, sdslen(host));
+    const char* path = SlotsMGRT_UnixPath(host);
+    if (path != NULL) {
+        name = sdscatlen(name, SLOTS_MGRT_UNIX_PREFIX,
+                         strlen(SLOTS_MGRT_UNIX_PREFIX));
+        return sdscatlen(name, path, strlen(path));
+    }
+    name = sdscatlen(name, host, strlen(host));
     name = sdscatlen(name, ":", 1);
-    name = sdscatlen(name, port, sdslen(port));
-    char buf[REDIS_LONGSTR_SIZE];
-    long long tid = getTid();
-    // long long tid = (long long)pthread_self();
-    m_ll2string(buf, sizeof(buf), tid);
-    name = sdscatlen(name, "@", 1);
-    name = sdscatlen(name, buf, strlen(buf));
-    return name;
+    return sdscatlen(name, port, strlen(port));
 }
 
-static db_slot_mgrt_connect* SlotsMGRT_GetConnCtx(RedisModuleCtx* ctx,
-                                                  slot_mgrt_connet_meta* meta) {
-    time_t unixtime = get_unixtime();
-    sds name = getConnName(meta->host, meta->port);
+// ack-only reader of mgrt conns, slotsrestore* replies are only checked for
+// errors, so don't alloc a redisReply per reply, every create fn return the
+// same static reply (need a real redisReply, hiredis check the push type),
+// errors are counted into the conn ack (reader privdata).
+static redisReply slotsmgrt_ack_reply = {.type = REDIS_REPLY_INTEGER};
+
+static void* ackCreateString(const redisReadTask* task, char* str,
+                             size_t len) {
+    slots_mgrt_ack* ack = task->privdata;
+    if (task->type == REDIS_REPLY_ERROR && ack != NULL) {
+        if (ack->errors++ == 0) {
+            if (len >= sizeof(ack->errmsg)) {
+                len = sizeof(ack->errmsg) - 1;
+            }
+            memcpy(ack->errmsg, str, len);
+            ack->errmsg[len] = '\0';
+        }
+    }
+    return &slotsmgrt_ack_reply;
+}
+
+static void* ackCreateArray(const redisReadTask* task, size_t elements) {
+    UNUSED(task);
+    UNUSED(elements);
+    return &slotsmgrt_ack_reply;
+}
+
+static void* ackCreateInteger(const redisReadTask* task, long long value) {
+    UNUSED(task);
+    UNUSED(value);
+    return &slotsmgrt_ack_reply;
+}
+
+static void* ackCreateDouble(const redisReadTask* task, double value,
+                             char* str, size_t len) {
+    UNUSED(task);
+    UNUSED(value);
+    UNUSED(str);
+    UNUSED(len);
+    return &slotsmgrt_ack_reply;
+}
 
-    db_slot_mgrt_connect* conn = NULL;
+static void* ackCreateNil(const redisReadTask* task) {
+    UNUSED(task);
+    return &slotsmgrt_ack_reply;
+}
+
+static void* ackCreateBool(const redisReadTask* task, int bval) {
+    UNUSED(task);
+    UNUSED(bval);
+    return &slotsmgrt_ack_reply;
+}
+
+static void ackFreeObject(void* obj) {
+    UNUSED(obj);
+}
+
+static redisReplyObjectFunctions slotsmgrt_ack_fns = {
+    ackCreateString, ackCreateArray, ackCreateInteger, ackCreateDouble,
+    ackCreateNil,    ackCreateBool,  ackFreeObject,
+};
+
+// withshm conn create its shm ring once, if can't create (no /dev/shm),
+// batches are sent on the conn as slotsrestorebin
+static void mgrtConnShm(RedisModuleCtx* ctx, db_slot_mgrt_connect* conn,
+                        slot_mgrt_connet_meta* meta) {
+    if (!(meta->flags & SLOTS_MGRT_SHM) || conn->shm != NULL) {
+        return;
+    }
+    conn->shm
+        = SlotsShm_RingCreate((size_t)g_slots_meta_info.mgrt_shm_ring_bytes);
+    if (conn->shm == NULL) {
+        RedisModule_Log(ctx, "warning",
+                        "slotsmgrt: create shm ring error = '%s', "
+                        "send batches on the conn",
+                        strerror(errno));
+    }
+}
+
+static void freeMgrtConn(db_slot_mgrt_connect* conn) {
+    redisFree(conn->conn_ctx);
+    SlotsShm_RingFree(conn->shm);
+    RedisModule_Free(conn);
+}
+
+// take the most recently used idle conn of the target out of the pool
+static db_slot_mgrt_connect* mgrtConnPoolGet(sds name) {
     pthread_mutex_lock(&slotsmgrt_cached_ctx_connects_lock);
-    // conn = m_dictFetchValue(slotsmgrt_cached_ctx_connects, name);
-    conn = RedisModule_DictGetC(slotsmgrt_cached_ctx_connects, (void*)name,
-                                sdslen(name), NULL);
-    pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
+    db_slot_mgrt_connect* conn = RedisModule_DictGetC(
+        slotsmgrt_cached_ctx_connects, (void*)name, sdslen(name), NULL);
     if (conn != NULL) {
-        sdsfree(name);
-        conn->last_time = unixtime;
-        return conn;
+        if (conn->next != NULL) {
+            RedisModule_DictReplaceC(slotsmgrt_cached_ctx_connects,
+                                     (void*)name, sdslen(name), conn->next);
+        } else {
+            RedisModule_DictDelC(slotsmgrt_cached_ctx_connects, (void*)name,
+                                 sdslen(name), NULL);
+        }
+        conn->next = NULL;
+        slotsmgrt_cached_ctx_connects_num--;
+    }
+    pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
+    return conn;
+}
+
+static void mgrtConnPoolPut(sds name, db_slot_mgrt_connect* conn) {
+    pthread_mutex_lock(&slotsmgrt_cached_ctx_connects_lock);
+    conn->next = RedisModule_DictGetC(slotsmgrt_cached_ctx_connects,
+                                      (void*)name, sdslen(name), NULL);
+    RedisModule_DictReplaceC(slotsmgrt_cached_ctx_connects, (void*)name,
+                             sdslen(name), conn);
+    slotsmgrt_cached_ctx_connects_num++;
+    pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
+}
+
+// take the idle pooled conn of the target for meta, NULL if none
+static db_slot_mgrt_connect* mgrtConnTake(RedisModuleCtx* ctx,
+                                          slot_mgrt_connet_meta* meta,
+                                          sds name) {
+    db_slot_mgrt_connect* conn = mgrtConnPoolGet(name);
+    if (conn == NULL) {
+        return NULL;
     }
+    redisSetTimeout(conn->conn_ctx, meta->timeout);
+    conn->last_time = get_unixtime();
+    conn->meta = meta;
+    mgrtConnShm(ctx, conn, meta);
+    return conn;
+}
 
-    redisContext* c = redisConnect(meta->host, atoi(meta->port));
-    if (c->err) {
+// connect a new conn to the target with timeout (if >0), so an unreachable
+// target don't block the caller for the kernel syn retries
+static db_slot_mgrt_connect* mgrtConnNew(RedisModuleCtx* ctx,
+                                         slot_mgrt_connet_meta* meta,
+                                         sds name) {
+    const char* path = SlotsMGRT_UnixPath(meta->host);
+    int timed = meta->timeout.tv_sec > 0 || meta->timeout.tv_usec > 0;
+    redisContext* c;
+    if (path != NULL) {
+        c = timed ? redisConnectUnixWithTimeout(path, meta->timeout)
+                  : redisConnectUnix(path);
+    } else {
+        c = timed ? redisConnectWithTimeout(meta->host, atoi(meta->port),
+                                            meta->timeout)
+                  : redisConnect(meta->host, atoi(meta->port));
+    }
+    if (c == NULL || c->err) {
         char errLog[200];
         sprintf(errLog, "Err: slotsmgrt connect to target %s, error = '%s'",
-                name, c->errstr);
+                name, c != NULL ? c->errstr : "can't allocate redis context");
         RedisModule_Log(ctx, "warning", "%s", errLog);
-        sdsfree(name);
+        MGRT_STATS_INCR(conn_errors, 1);
+        if (c != NULL) {
+            redisFree(c);
+        }
         return NULL;
     }
     redisSetTimeout(c, meta->timeout);
+    MGRT_STATS_INCR(conns_created, 1);
     RedisModule_Log(
-        ctx, "notice", "slotsmgrt: connect to target %s set timeout: %ld.%ld s",
+        ctx, "verbose", "slotsmgrt: connect to target %s set timeout: %ld.%ld s",
         name, meta->timeout.tv_sec, (long int)meta->timeout.tv_usec);
 
-    conn = RedisModule_Alloc(sizeof(db_slot_mgrt_connect));
+    db_slot_mgrt_connect* conn
+        = RedisModule_Alloc(sizeof(db_slot_mgrt_connect));
     conn->conn_ctx = c;
-    conn->last_time = unixtime;
+    conn->last_time = get_unixtime();
     conn->meta = meta;
+    conn->next = NULL;
+    conn->ack.errors = 0;
+    conn->ack.errmsg[0] = '\0';
+    c->reader->fn = &slotsmgrt_ack_fns;
+    c->reader->privdata = &conn->ack;
+    conn->shm = NULL;
+    mgrtConnShm(ctx, conn, meta);
+    return conn;
+}
 
-    pthread_mutex_lock(&slotsmgrt_cached_ctx_connects_lock);
-    // m_dictAdd(slotsmgrt_cached_ctx_connects, name, conn);
-    RedisModule_DictSetC(slotsmgrt_cached_ctx_connects, (void*)name,
-                         sdslen(name), conn);
-    pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
-
+// SlotsMGRT_GetConnCtx
+// take an idle pooled conn of the target or connect a new one.
+// the conn is used only by the caller until SlotsMGRT_ReleaseConn.
+static db_slot_mgrt_connect* SlotsMGRT_GetConnCtx(RedisModuleCtx* ctx,
+                                                  slot_mgrt_connet_meta* meta) {
+    sds name = SlotsMGRT_TargetName(meta->host, meta->port);
+    db_slot_mgrt_connect* conn = mgrtConnTake(ctx, meta, name);
+    if (conn == NULL) {
+        conn = mgrtConnNew(ctx, meta, name);
+    }
     sdsfree(name);
     return conn;
 }
 
-static void SlotsMGRT_CloseConn(RedisModuleCtx* ctx,
-                                slot_mgrt_connet_meta* meta) {
-    sds name = getConnName(meta->host, meta->port);
-
-    pthread_mutex_lock(&slotsmgrt_cached_ctx_connects_lock);
-    // db_slot_mgrt_connect* conn =
-    // m_dictFetchValue(slotsmgrt_cached_ctx_connects, name);
-    db_slot_mgrt_connect* conn = RedisModule_DictGetC(
-        slotsmgrt_cached_ctx_connects, (void*)name, sdslen(name), NULL);
-    pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
-    if (conn == NULL) {
-        RedisModule_Log(ctx, "warning", "slotsmgrt: close target %s again",
-                        name);
+// SlotsMGRT_ReleaseConn
+// ok: all replies are read, put the conn back to the idle pool,
+// else (err, replies maybe not read) close it
+static void SlotsMGRT_ReleaseConn(RedisModuleCtx* ctx,
+                                  db_slot_mgrt_connect* conn, int ok) {
+    sds name = SlotsMGRT_TargetName(conn->meta->host, conn->meta->port);
+    if (ok && conn->conn_ctx->err == 0) {
+        conn->last_time = get_unixtime();
+        mgrtConnPoolPut(name, conn);
         sdsfree(name);
         return;
     }
-    RedisModule_Log(ctx, "notice", "slotsmgrt: close target %s ok", name);
-    pthread_mutex_lock(&slotsmgrt_cached_ctx_connects_lock);
-    // m_dictDelete(slotsmgrt_cached_ctx_connects, name);
-    RedisModule_DictDelC(slotsmgrt_cached_ctx_connects, (void*)name,
-                         sdslen(name), NULL);
-    pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
-    redisFree(conn->conn_ctx);
-    RedisModule_Free(conn);
-    conn = NULL;
+
+    RedisModule_Log(ctx, "verbose", "slotsmgrt: close target %s ok", name);
+    freeMgrtConn(conn);
     sdsfree(name);
+    MGRT_STATS_INCR(conns_closed, 1);
 }
 
 // SlotsMGRT_CloseTimedoutConns
 // like migrateCloseTimedoutSockets
-// for server cron job to check timeout connect
+// for server cron job to close the idle pooled conns
 void SlotsMGRT_CloseTimedoutConns(RedisModuleCtx* ctx) {
     // maybe use cached server cron time, a little faster.
     time_t unixtime = get_unixtime();
 
     pthread_mutex_lock(&slotsmgrt_cached_ctx_connects_lock);
-    // m_dictIterator* di =
-    // m_dictGetSafeIterator(slotsmgrt_cached_ctx_connects);
     RedisModuleDictIter* di = RedisModule_DictIteratorStartC(
         slotsmgrt_cached_ctx_connects, "^", NULL, 0);
 
     void* k;
-    db_slot_mgrt_connect* conn;
-
-    // m_dictEntry* de;
-    // while ((de = dictNext(di)) != NULL) {
-    //     k = dictGetKey(de);
-    //     conn = dictGetVal(de);
     size_t keyLen;
+    db_slot_mgrt_connect* conn;
+    // targets whose idle conns are all timedout, del after the iteration
+    sds* empty = NULL;
+    int empty_n = 0;
     while ((k = RedisModule_DictNextC(di, &keyLen, (void**)&conn))) {
-        if ((unixtime - conn->last_time) > MGRT_BATCH_KEY_TIMEOUT) {
+        // idle list is ordered by last_time desc, cut at the first timedout
+        db_slot_mgrt_connect** link = NULL;
+        while (conn != NULL
+               && (unixtime - conn->last_time) <= MGRT_BATCH_KEY_TIMEOUT) {
+            link = &conn->next;
+            conn = conn->next;
+        }
+        if (conn == NULL) {
+            continue;
+        }
+        if (link != NULL) {
+            *link = NULL;
+        } else {
+            empty = RedisModule_Realloc(empty, sizeof(sds) * (empty_n + 1));
+            empty[empty_n++] = sdsnewlen(k, keyLen);
+        }
+        while (conn != NULL) {
+            db_slot_mgrt_connect* next = conn->next;
             RedisModule_Log(
                 ctx, "notice",
-                "slotsmgrt: timeout target %s, lasttime = %ld, now = %ld",
-                (sds)k, conn->last_time, unixtime);
-
-            // m_dictDelete(slotsmgrt_cached_ctx_connects, k);
-            RedisModule_DictDelC(slotsmgrt_cached_ctx_connects, k,
-                                 strlen((sds)k), NULL);
-
-            redisFree(conn->conn_ctx);
-            RedisModule_Free(conn);
-            conn = NULL;
+                "slotsmgrt: timeout target %.*s, lasttime = %ld, now = %ld",
+                (int)keyLen, (char*)k, conn->last_time, unixtime);
+            freeMgrtConn(conn);
+            slotsmgrt_cached_ctx_connects_num--;
+            MGRT_STATS_INCR(conns_closed, 1);
+            MGRT_STATS_INCR(conns_timedout, 1);
+            conn = next;
         }
     }
-
-    // m_dictReleaseIterator(di);
     RedisModule_DictIteratorStop(di);
+
+    for (int i = 0; i < empty_n; i++) {
+        RedisModule_DictDelC(slotsmgrt_cached_ctx_connects, empty[i],
+                             sdslen(empty[i]), NULL);
+        sdsfree(empty[i]);
+    }
+    RedisModule_Free(empty);
     pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
 }
 
+// idle pooled conns num
+uint64_t SlotsMGRT_CachedConnsNum(void) {
+    pthread_mutex_lock(&slotsmgrt_cached_ctx_connects_lock);
+    uint64_t n = slotsmgrt_cached_ctx_connects_num;
+    pthread_mutex_unlock(&slotsmgrt_cached_ctx_connects_lock);
+    return n;
+}
+
 static void freeHiRedisSlotsRestoreArgs(char** argv, size_t* argvlen, int n) {
     for (int i = 0; i < n; i++) {
         RedisModule_Free(argv[i * 3 + 1]);
@@ -366,119 +502,459 @@ static void freeHiRedisSlotsRestoreArgs(char** argv, size_t* argvlen, int n) {
     RedisModule_Free(argvlen);
 }
 
+// withcompress poor ratio vals streak, shared by sync/async/pool senders
+static uint32_t slotsmgrt_compress_poor = 0;
+
+// SlotsMGRT_CompressVal
+// lzf compress a dump val to out (vsz - vsz/8 bytes),
+// return compressed len, 0 to send the raw val (small or poor ratio)
+size_t SlotsMGRT_CompressVal(const char* v, size_t vsz, char* out) {
+    if (vsz < SLOTS_MGRT_COMPRESS_MIN_BYTES) {
+        return 0;
+    }
+    // poor ratio streak (random/already compressed vals), only probe some
+    uint32_t poor
+        = __atomic_load_n(&slotsmgrt_compress_poor, __ATOMIC_RELAXED);
+    if (poor >= SLOTS_MGRT_COMPRESS_POOR_STREAK
+        && __atomic_add_fetch(&slotsmgrt_compress_poor, 1, __ATOMIC_RELAXED)
+                   % SLOTS_MGRT_COMPRESS_PROBE
+               != 0) {
+        return 0;
+    }
+    size_t clen = m_lzf_compress(v, vsz, out, vsz - vsz / 8);
+    if (clen == 0) {
+        if (poor < SLOTS_MGRT_COMPRESS_POOR_STREAK) {
+            __atomic_add_fetch(&slotsmgrt_compress_poor, 1, __ATOMIC_RELAXED);
+        }
+        return 0;
+    }
+    __atomic_store_n(&slotsmgrt_compress_poor, 0, __ATOMIC_RELAXED);
+    return clen;
+}
+
+// fill sub argv (from 1) with slotsrestorelzf key ttl rawlen val args,
+// return the buf of rawlen strs and compressed vals, free it after send
+static char* compressRestoreArgs(char** argv, size_t* argvlen, int start_pos,
+                                 int end_pos, char** sub_argv,
+                                 size_t* sub_argvlen) {
+    size_t cap = 0;
+    for (int i = start_pos; i < end_pos; i++) {
+        cap += REDIS_LONGSTR_SIZE + argvlen[i * 3 + 2]
+               - argvlen[i * 3 + 2] / 8;
+    }
+    char* buf = RedisModule_Alloc(cap);
+    char* p = buf;
+    size_t raw_bytes = 0, bytes = 0;
+    for (int i = start_pos; i < end_pos; i++) {
+        int j = (i - start_pos) * 4 + 1;
+        const char* v = argv[i * 3 + 2];
+        size_t vsz = argvlen[i * 3 + 2];
+        char* rawlen = p;
+        char* out = p + REDIS_LONGSTR_SIZE;
+        p = out + vsz - vsz / 8;
+
+        size_t clen = SlotsMGRT_CompressVal(v, vsz, out);
+        sub_argv[j] = argv[i * 3];
+        sub_argvlen[j] = argvlen[i * 3];
+        sub_argv[j + 1] = argv[i * 3 + 1];
+        sub_argvlen[j + 1] = argvlen[i * 3 + 1];
+        sub_argv[j + 2] = rawlen;
+        sub_argvlen[j + 2] = m_ll2string(rawlen, REDIS_LONGSTR_SIZE,
+                                         clen > 0 ? (long long)vsz : 0);
+        sub_argv[j + 3] = clen > 0 ? out : (char*)v;
+        sub_argvlen[j + 3] = clen > 0 ? clen : vsz;
+        raw_bytes += vsz;
+        bytes += sub_argvlen[j + 3];
+    }
+    MGRT_STATS_INCR(compress_raw_bytes, raw_bytes);
+    MGRT_STATS_INCR(compress_bytes, bytes);
+    return buf;
+}
+
+// read n pipelined slotsrestore* replies of objs [start_pos, end_pos)
+// with the conn ack-only reader, no reply is allocated,
+// err return SLOTS_MGRT_ERR, ok return n
+static int doSplitPipelineGetReply(RedisModuleCtx* ctx,
+                                   db_slot_mgrt_connect* conn, int start_pos,
+                                   int end_pos, int n) {
+    if (n <= 0) {
+        return SLOTS_MGRT_NOTHING;
+    }
+    conn->ack.errors = 0;
+    for (int i = 0; i < n; i++) {
+        void* reply = NULL;
+        if (redisGetReply(conn->conn_ctx, &reply) == REDIS_ERR
+            || reply == NULL) {
+            RedisModule_Log(ctx, "warning",
+                            "[%s %d] start_pos %d end_pos %d pos: %d "
+                            "pipeline send fail! err: %s",
+                            __FILE__, __LINE__, start_pos, end_pos, i - 1,
+                            conn->conn_ctx->errstr);
+            return SLOTS_MGRT_ERR;
+        }
+    }
+    if (conn->ack.errors > 0) {
+        RedisModule_Log(ctx, "warning",
+                        "[%s %d] start_pos %d end_pos %d %d errors, "
+                        "pipeline send fail! err: %s",
+                        __FILE__, __LINE__, start_pos, end_pos,
+                        conn->ack.errors, conn->ack.errmsg);
+        return SLOTS_MGRT_ERR;
+    }
+
+    RedisModule_Log(ctx, "verbose", "start_pos %d end_pos %d pipeline send ok",
+                    start_pos, end_pos);
+    return n;
+}
+
+// select the target db on a mgrt conn, ack with the conn reader
+static int mgrtSelectDb(RedisModuleCtx* ctx, db_slot_mgrt_connect* conn,
+                        int db) {
+    if (redisAppendCommand(conn->conn_ctx, "SELECT %d", db) != REDIS_OK) {
+        return SLOTS_MGRT_ERR;
+    }
+    return doSplitPipelineGetReply(ctx, conn, 0, 0, 1);
+}
+
+// SlotsMGRT_GetDbConn
+// like SlotsMGRT_GetConnCtx and select meta->db on the conn. a pooled conn
+// maybe closed by the target while idle (timeout, restart), if select err
+// on it close it and retry once with a new conn.
+static db_slot_mgrt_connect* SlotsMGRT_GetDbConn(RedisModuleCtx* ctx,
+                                                 slot_mgrt_connet_meta* meta) {
+    sds name = SlotsMGRT_TargetName(meta->host, meta->port);
+    db_slot_mgrt_connect* conn = mgrtConnTake(ctx, meta, name);
+    if (conn != NULL) {
+        if (mgrtSelectDb(ctx, conn, meta->db) != SLOTS_MGRT_ERR) {
+            sdsfree(name);
+            return conn;
+        }
+        RedisModule_Log(ctx, "verbose",
+                        "slotsmgrt: pooled conn to target %s is stale, "
+                        "reconnect",
+                        name);
+        SlotsMGRT_ReleaseConn(ctx, conn, 0);
+    }
+    conn = mgrtConnNew(ctx, meta, name);
+    sdsfree(name);
+    if (conn == NULL) {
+        return NULL;
+    }
+    if (mgrtSelectDb(ctx, conn, meta->db) == SLOTS_MGRT_ERR) {
+        SlotsMGRT_ReleaseConn(ctx, conn, 0);
+        return NULL;
+    }
+    return conn;
+}
+
+// SlotsMGRT_Connect
+// pre-connect count conns to the target into the idle pool ahead of mgrt
+// (thread pool workers / async threads take them), health-checked with
+// PING, broken idle conns are closed and reconnected.
+// return ready conns num
+int SlotsMGRT_Connect(RedisModuleCtx* ctx, const char* host, const char* port,
+                      time_t timeoutMS, int count) {
+    struct timeval timeout
+        = {.tv_sec = timeoutMS / 1000, .tv_usec = (timeoutMS % 1000) * 1000};
+    slot_mgrt_connet_meta meta = {.db = 0,
+                                  .host = (sds)host,
+                                  .port = (sds)port,
+                                  .timeout = timeout,
+                                  .flags = 0};
+    db_slot_mgrt_connect** conns
+        = RedisModule_Alloc(sizeof(db_slot_mgrt_connect*) * count);
+    int n = 0;
+    for (int tries = 0; n < count && tries < count * 2; tries++) {
+        db_slot_mgrt_connect* conn = SlotsMGRT_GetConnCtx(ctx, &meta);
+        if (conn == NULL) {
+            break;
+        }
+        if (redisAppendCommand(conn->conn_ctx, "PING") != REDIS_OK
+            || doSplitPipelineGetReply(ctx, conn, 0, 0, 1) == SLOTS_MGRT_ERR) {
+            SlotsMGRT_ReleaseConn(ctx, conn, 0);
+            continue;
+        }
+        conns[n++] = conn;
+    }
+    for (int i = 0; i < n; i++) {
+        SlotsMGRT_ReleaseConn(ctx, conns[i], 1);
+    }
+    RedisModule_Free(conns);
+    return n;
+}
+
+// mgrt pipe: send split chunks to a conn without waiting the acks,
+// at most mgrt_pipeline_window chunks in flight, wait the oldest chunk acks
+// before send a new one, so the send isn't limited by the round trip.
+static void mgrtPipeInit(slots_mgrt_pipe* pipe, db_slot_mgrt_connect* conn) {
+    pipe->conn = conn;
+    pipe->window = g_slots_meta_info.mgrt_pipeline_window > 0
+                       ? g_slots_meta_info.mgrt_pipeline_window
+                       : 1;
+    pipe->head = 0;
+    pipe->len = 0;
+    pipe->chunks
+        = RedisModule_Alloc(sizeof(slots_mgrt_pipe_chunk) * pipe->window);
+}
+
+static void mgrtPipeFree(slots_mgrt_pipe* pipe) {
+    RedisModule_Free(pipe->chunks);
+    pipe->chunks = NULL;
+}
+
+// wait the oldest chunk acks
+static int mgrtPipeAck(RedisModuleCtx* ctx, slots_mgrt_pipe* pipe) {
+    slots_mgrt_pipe_chunk* c = &pipe->chunks[pipe->head];
+    pipe->head = (pipe->head + 1) % pipe->window;
+    pipe->len--;
+    int r = doSplitPipelineGetReply(ctx, pipe->conn, c->start_pos, c->end_pos,
+                                    c->replies);
+    if (r != SLOTS_MGRT_ERR && pipe->conn->shm != NULL) {
+        SlotsShm_RingRelease(pipe->conn->shm, c->shm_end);
+    }
+    return r;
+}
+
+// mgrtPipeReserve
+// call before append a chunk cmds, wait acks until the window has room
+static int mgrtPipeReserve(RedisModuleCtx* ctx, slots_mgrt_pipe* pipe) {
+    while (pipe->len >= pipe->window) {
+        if (mgrtPipeAck(ctx, pipe) == SLOTS_MGRT_ERR) {
+            return SLOTS_MGRT_ERR;
+        }
+    }
+    return 0;
+}
+
+// mgrtPipePush
+// write the appended chunk cmds of objs [start_pos, end_pos) to the target,
+// the chunk expect replies acks
+static int mgrtPipePush(RedisModuleCtx* ctx, slots_mgrt_pipe* pipe,
+                        int start_pos, int end_pos, int replies) {
+    redisContext* c = pipe->conn->conn_ctx;
+    int done = 0;
+    do {
+        if (redisBufferWrite(c, &done) == REDIS_ERR) {
+            RedisModule_Log(ctx, "warning", "errno %d errstr %s", c->err,
+                            c->errstr);
+            return SLOTS_MGRT_ERR;
+        }
+    } while (!done);
+
+    slots_mgrt_pipe_chunk* chunk
+        = &pipe->chunks[(pipe->head + pipe->len) % pipe->window];
+    chunk->start_pos = start_pos;
+    chunk->end_pos = end_pos;
+    chunk->replies = replies;
+    chunk->shm_end = pipe->conn->shm != NULL ? pipe->conn->shm->wpos : 0;
+    pipe->len++;
+    return 0;
+}
+
+// wait all in flight chunks acks
+static int mgrtPipeDrain(RedisModuleCtx* ctx, slots_mgrt_pipe* pipe) {
+    while (pipe->len > 0) {
+        if (mgrtPipeAck(ctx, pipe) == SLOTS_MGRT_ERR) {
+            return SLOTS_MGRT_ERR;
+        }
+    }
+    return 0;
+}
+
 /*
+ *  send objs [start_pos, end_pos) as one slotsrestore cmd in the pipe,
  *  err return SLOTS_MGRT_ERR, ok return obj cn,
+ *  compress: send slotsrestorelzf with lzf compressed vals
  */
-static int doSplitRestoreCommand(RedisModuleCtx* ctx,
-                                 db_slot_mgrt_connect* conn, char** argv,
-                                 size_t* argvlen, int start_pos, int end_pos) {
+static int doSplitRestoreCommand(RedisModuleCtx* ctx, slots_mgrt_pipe* pipe,
+                                 char** argv, size_t* argvlen, int start_pos,
+                                 int end_pos, int compress) {
     int obj_cn = end_pos - start_pos;
     if (obj_cn <= 0) {
         return SLOTS_MGRT_NOTHING;
     }
+    if (mgrtPipeReserve(ctx, pipe) == SLOTS_MGRT_ERR) {
+        return SLOTS_MGRT_ERR;
+    }
+    int stride = compress ? 4 : 3;
     // alloc with memory alignment, so sizeof(char*) * 3 * obj_cn + 1 is ok
-    char** sub_argv = RedisModule_Alloc(sizeof(char*) * (3 * obj_cn + 1));
-    size_t* sub_argvlen = RedisModule_Alloc(sizeof(size_t) * (3 * obj_cn + 1));
-    sub_argv[0] = "SLOTSRESTORE";
-    // cp pointer
-    memcpy(&sub_argv[1], &argv[start_pos * 3], sizeof(char*) * obj_cn * 3);
+    char** sub_argv = RedisModule_Alloc(sizeof(char*) * (stride * obj_cn + 1));
+    size_t* sub_argvlen
+        = RedisModule_Alloc(sizeof(size_t) * (stride * obj_cn + 1));
+    sub_argv[0] = compress ? "SLOTSRESTORELZF" : "SLOTSRESTORE";
     sub_argvlen[0] = strlen(sub_argv[0]);
-    memcpy(&sub_argvlen[1], &argvlen[start_pos * 3],
-           sizeof(size_t) * obj_cn * 3);
-
-    redisReply* rr
-        = redisCommandArgv(conn->conn_ctx, 3 * obj_cn + 1,
-                           (const char**)sub_argv, (const size_t*)sub_argvlen);
-    if (conn->conn_ctx->err) {
-        RedisModule_Log(ctx, "warning", "errno %d errstr %s",
-                        conn->conn_ctx->err, conn->conn_ctx->errstr);
-        freeHiRedisSlotsRestoreArgs(sub_argv, sub_argvlen, 0);
-        return SLOTS_MGRT_ERR;
+    char* zbuf = NULL;
+    if (compress) {
+        zbuf = compressRestoreArgs(argv, argvlen, start_pos, end_pos, sub_argv,
+                                   sub_argvlen);
+    } else {
+        // cp pointer
+        memcpy(&sub_argv[1], &argv[start_pos * 3], sizeof(char*) * obj_cn * 3);
+        memcpy(&sub_argvlen[1], &argvlen[start_pos * 3],
+               sizeof(size_t) * obj_cn * 3);
     }
-    if (rr == NULL) {
-        RedisModule_Log(ctx, "warning", "reply is NULL");
-        freeHiRedisSlotsRestoreArgs(sub_argv, sub_argvlen, 0);
-        return SLOTS_MGRT_ERR;
+
+    // formatted to the conn obuf, args can be freed
+    int r = redisAppendCommandArgv(pipe->conn->conn_ctx, stride * obj_cn + 1,
+                                   (const char**)sub_argv,
+                                   (const size_t*)sub_argvlen);
+    if (zbuf != NULL) {
+        RedisModule_Free(zbuf);
     }
-    if (rr->type == REDIS_REPLY_ERROR) {
-        RedisModule_Log(ctx, "warning", "reply err %s", rr->str);
-        freeReplyObject(rr);
-        freeHiRedisSlotsRestoreArgs(sub_argv, sub_argvlen, 0);
+    freeHiRedisSlotsRestoreArgs(sub_argv, sub_argvlen, 0);
+    if (r != REDIS_OK
+        || mgrtPipePush(ctx, pipe, start_pos, end_pos, 1) == SLOTS_MGRT_ERR) {
         return SLOTS_MGRT_ERR;
     }
+    return obj_cn;
+}
 
-    RedisModule_Log(ctx, "notice", "start_pos %d end_pos %d send ok", start_pos,
-                    end_pos);
+/*
+ *  encode objs [start_pos, end_pos) batch (bound bytes at most) into the
+ *  conn shm ring, send a slotsrestoreshm descriptor in the pipe,
+ *  wait acks to free ring bytes if the ring is full.
+ *  err return SLOTS_MGRT_ERR, ok return obj cn
+ */
+static int doSplitRestoreShmCommand(RedisModuleCtx* ctx, slots_mgrt_pipe* pipe,
+                                    rdb_dump_obj* objs[], int start_pos,
+                                    int end_pos, int compress, size_t bound) {
+    slots_shm_ring* ring = pipe->conn->shm;
+    size_t off;
+    char* buf;
+    while ((buf = SlotsShm_RingReserve(ring, bound, &off)) == NULL) {
+        if (pipe->len == 0 || mgrtPipeAck(ctx, pipe) == SLOTS_MGRT_ERR) {
+            return SLOTS_MGRT_ERR;
+        }
+    }
+    size_t len = SlotsBatch_Encode(objs, start_pos, end_pos, compress, buf);
+    SlotsShm_RingCommit(ring, len);
+    MGRT_STATS_INCR(shm_bytes, len);
 
-    freeReplyObject(rr);
-    freeHiRedisSlotsRestoreArgs(sub_argv, sub_argvlen, 0);
+    int r = redisAppendCommand(
+        pipe->conn->conn_ctx, "SLOTSRESTORESHM %s %llu %llu", ring->name,
+        (unsigned long long)off, (unsigned long long)len);
+    if (r != REDIS_OK
+        || mgrtPipePush(ctx, pipe, start_pos, end_pos, 1) == SLOTS_MGRT_ERR) {
+        return SLOTS_MGRT_ERR;
+    }
+    return end_pos - start_pos;
+}
+
+/*
+ *  send objs [start_pos, end_pos) as one slotsrestorebin batch in the pipe,
+ *  withshm conn write the batch into the shm ring if it fits,
+ *  err return SLOTS_MGRT_ERR, ok return obj cn
+ */
+static int doSplitRestoreBinCommand(RedisModuleCtx* ctx, slots_mgrt_pipe* pipe,
+                                    rdb_dump_obj* objs[], int start_pos,
+                                    int end_pos, int compress) {
+    int obj_cn = end_pos - start_pos;
+    if (obj_cn <= 0) {
+        return SLOTS_MGRT_NOTHING;
+    }
+    if (mgrtPipeReserve(ctx, pipe) == SLOTS_MGRT_ERR) {
+        return SLOTS_MGRT_ERR;
+    }
+    size_t bound = SlotsBatch_EncodeBound(objs, start_pos, end_pos);
+    if ((pipe->conn->meta->flags & SLOTS_MGRT_SHM) && pipe->conn->shm != NULL
+        && bound <= pipe->conn->shm->size) {
+        return doSplitRestoreShmCommand(ctx, pipe, objs, start_pos, end_pos,
+                                        compress, bound);
+    }
+    char* buf = RedisModule_Alloc(bound);
+    size_t len = SlotsBatch_Encode(objs, start_pos, end_pos, compress, buf);
+    const char* argv[2] = {"SLOTSRESTOREBIN", buf};
+    size_t argvlen[2] = {strlen(argv[0]), len};
+
+    int r = redisAppendCommandArgv(pipe->conn->conn_ctx, 2, argv, argvlen);
+    RedisModule_Free(buf);
+    if (r != REDIS_OK
+        || mgrtPipePush(ctx, pipe, start_pos, end_pos, 1) == SLOTS_MGRT_ERR) {
+        return SLOTS_MGRT_ERR;
+    }
     return obj_cn;
 }
 
+// doSplitRestoreCmdTask
+// thread pool worker send its chunks [chunk_start, chunk_end) pipelined
+// on the worker conn
 static void doSplitRestoreCmdTask(void* arg) {
     RedisModuleCtx* ctx = RedisModule_GetThreadSafeContext(NULL);
     slots_split_restore_params* params = (slots_split_restore_params*)arg;
-    db_slot_mgrt_connect* conn = SlotsMGRT_GetConnCtx(ctx, params->meta);
+    // todo auth
+    db_slot_mgrt_connect* conn = SlotsMGRT_GetDbConn(ctx, params->meta);
     if (conn == NULL) {
         params->result_code = SLOTS_MGRT_ERR;
+        RedisModule_FreeThreadSafeContext(ctx);
         return;
     }
-    // todo auth
 
-    redisReply* rr;
-    rr = redisCommand(conn->conn_ctx, "SELECT %d", params->meta->db);
-    if (rr == NULL || rr->type == REDIS_REPLY_ERROR) {
-        if (rr != NULL) {
-            freeReplyObject(rr);
+    int compress = params->meta->flags & SLOTS_MGRT_COMPRESS;
+    int binary = params->meta->flags & SLOTS_MGRT_BINARY;
+    slots_mgrt_pipe pipe;
+    mgrtPipeInit(&pipe, conn);
+    int ret = 0;
+    for (int c = params->chunk_start; c < params->chunk_end; c++) {
+        int start_pos = params->bounds[c];
+        int end_pos = params->bounds[c + 1];
+        int r = binary ? doSplitRestoreBinCommand(ctx, &pipe, params->objs,
+                                                  start_pos, end_pos, compress)
+                       : doSplitRestoreCommand(ctx, &pipe, params->argv,
+                                               params->argvlen, start_pos,
+                                               end_pos, compress);
+        if (r == SLOTS_MGRT_ERR) {
+            ret = SLOTS_MGRT_ERR;
+            break;
         }
-        params->result_code = SLOTS_MGRT_ERR;
-        return;
+        ret += r;
     }
-    freeReplyObject(rr);
-
-    params->result_code
-        = doSplitRestoreCommand(ctx, conn, params->argv, params->argvlen,
-                                params->start_pos, params->end_pos);
+    if (ret != SLOTS_MGRT_ERR && mgrtPipeDrain(ctx, &pipe) == SLOTS_MGRT_ERR) {
+        ret = SLOTS_MGRT_ERR;
+    }
+    mgrtPipeFree(&pipe);
+    params->result_code = ret;
 
-    conn->last_time = get_unixtime();
-    SlotsMGRT_CloseConn(ctx, params->meta);
+    SlotsMGRT_ReleaseConn(ctx, conn, ret != SLOTS_MGRT_ERR);
     RedisModule_FreeThreadSafeContext(ctx);
 }
 
 static int BatchSendWithThreadPool_SlotsRestore(RedisModuleCtx* ctx,
                                                 slot_mgrt_connet_meta* meta,
-                                                rdb_dump_obj* objs[], int n) {
+                                                rdb_dump_obj* objs[], int n,
+                                                size_t batch_bytes) {
     UNUSED(ctx);
-    threadpool thpool = thpool_init(g_slots_meta_info.slots_mgrt_threads);
-    slots_split_restore_params* params
-        = RedisModule_Alloc(sizeof(slots_split_restore_params) * n);
-    int params_cn = 0;
+    // withbinary: workers encode objs, split only by key/val bytes
+    int binary = meta->flags & SLOTS_MGRT_BINARY;
+    // split chunk i is objs [bounds[i], bounds[i + 1])
+    int* bounds = RedisModule_Alloc(sizeof(int) * (n + 1));
+    int chunks = 0;
 
+    // resp slotsrestore argv, binary frames are encoded from objs
     // char* argv[3 * n];
-    char** argv = RedisModule_Alloc(sizeof(char*) * 3 * n);
+    char** argv = NULL;
     // size_t argvlen[3 * n];
-    size_t* argvlen = RedisModule_Alloc(sizeof(size_t) * 3 * n);
+    size_t* argvlen = NULL;
+    if (!binary) {
+        argv = RedisModule_Alloc(sizeof(char*) * 3 * n);
+        argvlen = RedisModule_Alloc(sizeof(size_t) * 3 * n);
+    }
     char buf[REDIS_LONGSTR_SIZE];
     size_t cmd_size = 0;
-    int start_pos = 0;
+    bounds[0] = 0;
     for (int i = 0; i < n; i++) {
         // split cmd (bigkey? if async block mgrt, maybe don't think this)
-        if (cmd_size > REDIS_MGRT_CMD_PARAMS_SIZE) {
-            params[params_cn].meta = meta;
-            params[params_cn].argv = argv;
-            params[params_cn].argvlen = argvlen;
-            params[params_cn].start_pos = start_pos;
-            params[params_cn].end_pos = i;
-            params[params_cn].result_code = 0;
-            thpool_add_work(thpool, doSplitRestoreCmdTask,
-                            (void*)&params[params_cn]);
-            params_cn++;
-
+        if (cmd_size > batch_bytes) {
+            bounds[++chunks] = i;
             cmd_size = 0;
-            start_pos = i;
         }
 
         size_t ksz, vsz;
+        if (binary) {
+            RedisModule_StringPtrLen(objs[i]->key, &ksz);
+            RedisModule_StringPtrLen(objs[i]->val, &vsz);
+            cmd_size += ksz + vsz;
+            continue;
+        }
         argv[i * 3 + 0] = (char*)RedisModule_StringPtrLen(objs[i]->key, &ksz);
         argvlen[i * 3 + 0] = ksz;
         cmd_size += argvlen[i * 3 + 0];
@@ -492,48 +968,66 @@ static int BatchSendWithThreadPool_SlotsRestore(RedisModuleCtx* ctx,
         argvlen[i * 3 + 2] = vsz;
         cmd_size += argvlen[i * 3 + 2];
     }
+    bounds[++chunks] = n;
 
-    params[params_cn].meta = meta;
-    params[params_cn].argv = argv;
-    params[params_cn].argvlen = argvlen;
-    params[params_cn].start_pos = start_pos;
-    params[params_cn].end_pos = n;
-    params[params_cn].result_code = 0;
-    thpool_add_work(thpool, doSplitRestoreCmdTask, (void*)&params[params_cn]);
-    params_cn++;
-
+    // each worker pipeline a contiguous range of chunks on its conn
+    int tasks = chunks < g_slots_meta_info.slots_mgrt_threads
+                    ? chunks
+                    : g_slots_meta_info.slots_mgrt_threads;
+    threadpool thpool = thpool_init(tasks);
+    slots_split_restore_params* params
+        = RedisModule_Alloc(sizeof(slots_split_restore_params) * tasks);
+    for (int t = 0; t < tasks; t++) {
+        params[t].meta = meta;
+        params[t].objs = objs;
+        params[t].argv = argv;
+        params[t].argvlen = argvlen;
+        params[t].bounds = bounds;
+        params[t].chunk_start = (int)((long long)chunks * t / tasks);
+        params[t].chunk_end = (int)((long long)chunks * (t + 1) / tasks);
+        params[t].result_code = 0;
+        thpool_add_work(thpool, doSplitRestoreCmdTask, (void*)&params[t]);
+    }
     thpool_wait(thpool);
     thpool_destroy(thpool);
 
-    for (int i = 0; i < params_cn; i++) {
-        if (params[i].result_code == SLOTS_MGRT_ERR) {
-            freeHiRedisSlotsRestoreArgs(argv, argvlen, n);
-            RedisModule_Free(params);
-            return SLOTS_MGRT_ERR;
+    int ret = n;
+    for (int t = 0; t < tasks; t++) {
+        if (params[t].result_code == SLOTS_MGRT_ERR) {
+            ret = SLOTS_MGRT_ERR;
+            break;
         }
     }
 
-    freeHiRedisSlotsRestoreArgs(argv, argvlen, n);
+    if (!binary) {
+        freeHiRedisSlotsRestoreArgs(argv, argvlen, n);
+    }
     RedisModule_Free(params);
-    return n;
+    RedisModule_Free(bounds);
+    return ret;
 }
 
 static int BatchSend_SlotsRestore(RedisModuleCtx* ctx,
                                   db_slot_mgrt_connect* conn,
-                                  rdb_dump_obj* objs[], int n) {
+                                  rdb_dump_obj* objs[], int n,
+                                  size_t batch_bytes, int compress) {
     // char* argv[3 * n];
     char** argv = RedisModule_Alloc(sizeof(char*) * 3 * n);
     // size_t argvlen[3 * n];
     size_t* argvlen = RedisModule_Alloc(sizeof(size_t) * 3 * n);
     char buf[REDIS_LONGSTR_SIZE];
+    slots_mgrt_pipe pipe;
+    mgrtPipeInit(&pipe, conn);
     size_t cmd_size = 0;
     int start_pos = 0;
     for (int i = 0; i < n; i++) {
         // split cmd to send,(todo: bigkey)
-        if (cmd_size > REDIS_MGRT_CMD_PARAMS_SIZE) {
-            if (doSplitRestoreCommand(ctx, conn, argv, argvlen, start_pos, i)
+        if (cmd_size > batch_bytes) {
+            if (doSplitRestoreCommand(ctx, &pipe, argv, argvlen, start_pos, i,
+                                      compress)
                 == SLOTS_MGRT_ERR) {
-                freeHiRedisSlotsRestoreArgs(argv, argvlen, i - start_pos);
+                mgrtPipeFree(&pipe);
+                freeHiRedisSlotsRestoreArgs(argv, argvlen, i);
                 return SLOTS_MGRT_ERR;
             }
             cmd_size = 0;
@@ -555,87 +1049,85 @@ static int BatchSend_SlotsRestore(RedisModuleCtx* ctx,
         cmd_size += argvlen[i * 3 + 2];
     }
 
-    if (doSplitRestoreCommand(ctx, conn, argv, argvlen, start_pos, n)
-        == SLOTS_MGRT_ERR) {
+    if (doSplitRestoreCommand(ctx, &pipe, argv, argvlen, start_pos, n,
+                              compress)
+            == SLOTS_MGRT_ERR
+        || mgrtPipeDrain(ctx, &pipe) == SLOTS_MGRT_ERR) {
+        mgrtPipeFree(&pipe);
         freeHiRedisSlotsRestoreArgs(argv, argvlen, n);
         return SLOTS_MGRT_ERR;
     }
 
     conn->last_time = get_unixtime();
+    mgrtPipeFree(&pipe);
     freeHiRedisSlotsRestoreArgs(argv, argvlen, n);
     return n;
 }
 
-static int doSplitPipelineGetReply(RedisModuleCtx* ctx,
-                                   db_slot_mgrt_connect* conn, int start_pos,
-                                   int end_pos) {
-    UNUSED(ctx);
-    int n = end_pos - start_pos;
-    if (n <= 0) {
-        return SLOTS_MGRT_NOTHING;
-    }
-    redisReply** rr = RedisModule_Alloc(sizeof(redisReply*) * n);
+static int BatchSendBin_SlotsRestore(RedisModuleCtx* ctx,
+                                     db_slot_mgrt_connect* conn,
+                                     rdb_dump_obj* objs[], int n,
+                                     size_t batch_bytes, int compress) {
+    slots_mgrt_pipe pipe;
+    mgrtPipeInit(&pipe, conn);
+    size_t cmd_size = 0;
+    int start_pos = 0;
     for (int i = 0; i < n; i++) {
-        int r = redisGetReply(conn->conn_ctx, (void*)&rr[i]);
-        if (r == REDIS_ERR) {
-            RedisModule_Log(
-                ctx, "warning",
-                "[%s %d] start_pos %d end_pos %d pos: %d pipeline send fail!",
-                __FILE__, __LINE__, start_pos, end_pos, i - 1);
-            for (int j = 0; j < i; j++)
-                freeReplyObject(rr[j]);
-            RedisModule_Free(rr);
-            return SLOTS_MGRT_ERR;
-        }
-        if (rr[i] == NULL) {
-            RedisModule_Log(
-                ctx, "warning",
-                "[%s %d] start_pos %d end_pos %d pos: %d pipeline send fail!",
-                __FILE__, __LINE__, start_pos, end_pos, i - 1);
-            for (int j = 0; j < i; j++)
-                freeReplyObject(rr[j]);
-            RedisModule_Free(rr);
-            return SLOTS_MGRT_ERR;
-        }
-        if (rr[i]->type == REDIS_REPLY_ERROR) {
-            RedisModule_Log(
-                ctx, "warning",
-                "[%s %d] start_pos %d end_pos %d pos: %d pipeline send fail!",
-                __FILE__, __LINE__, start_pos, end_pos, i);
-            for (int j = 0; j <= i; j++)
-                freeReplyObject(rr[j]);
-            RedisModule_Free(rr);
-            return SLOTS_MGRT_ERR;
+        // split batch to send
+        if (cmd_size > batch_bytes) {
+            if (doSplitRestoreBinCommand(ctx, &pipe, objs, start_pos, i,
+                                         compress)
+                == SLOTS_MGRT_ERR) {
+                mgrtPipeFree(&pipe);
+                return SLOTS_MGRT_ERR;
+            }
+            cmd_size = 0;
+            start_pos = i;
         }
+        size_t ksz, vsz;
+        RedisModule_StringPtrLen(objs[i]->key, &ksz);
+        RedisModule_StringPtrLen(objs[i]->val, &vsz);
+        cmd_size += ksz + vsz;
     }
 
-    for (int j = 0; j < n; j++) {
-        freeReplyObject(rr[j]);
+    if (doSplitRestoreBinCommand(ctx, &pipe, objs, start_pos, n, compress)
+            == SLOTS_MGRT_ERR
+        || mgrtPipeDrain(ctx, &pipe) == SLOTS_MGRT_ERR) {
+        mgrtPipeFree(&pipe);
+        return SLOTS_MGRT_ERR;
     }
 
-    RedisModule_Free(rr);
-    RedisModule_Log(ctx, "notice", "start_pos %d end_pos %d pipeline send ok",
-                    start_pos, end_pos);
+    conn->last_time = get_unixtime();
+    mgrtPipeFree(&pipe);
     return n;
 }
 
+// withpipeline: one slotsrestore per key, split chunks in the pipe window
 static int Pipeline_SlotsRestore(RedisModuleCtx* ctx,
                                  db_slot_mgrt_connect* conn,
-                                 rdb_dump_obj* objs[], int n) {
-    UNUSED(ctx);
+                                 rdb_dump_obj* objs[], int n,
+                                 size_t batch_bytes) {
     char buf[REDIS_LONGSTR_SIZE];
     size_t cmd_size = 0, ksz = 0, vsz = 0, tsz = 0;
+    slots_mgrt_pipe pipe;
+    mgrtPipeInit(&pipe, conn);
+    int ret = n;
     int start_pos = 0;
     for (int i = 0; i < n; i++) {
         // split cmd to send,(todo: bigkey)
-        if (cmd_size > REDIS_MGRT_CMD_PARAMS_SIZE) {
-            if (doSplitPipelineGetReply(ctx, conn, start_pos, i)
+        if (cmd_size > batch_bytes) {
+            if (mgrtPipePush(ctx, &pipe, start_pos, i, i - start_pos)
                 == SLOTS_MGRT_ERR) {
-                return SLOTS_MGRT_ERR;
+                ret = SLOTS_MGRT_ERR;
+                break;
             }
             cmd_size = 0;
             start_pos = i;
         }
+        if (i == start_pos && mgrtPipeReserve(ctx, &pipe) == SLOTS_MGRT_ERR) {
+            ret = SLOTS_MGRT_ERR;
+            break;
+        }
 
         const char* k = RedisModule_StringPtrLen(objs[i]->key, &ksz);
         cmd_size += ksz;
@@ -648,67 +1140,101 @@ static int Pipeline_SlotsRestore(RedisModuleCtx* ctx,
                            ttlms, v, vsz);
     }
 
-    if (doSplitPipelineGetReply(ctx, conn, start_pos, n) == SLOTS_MGRT_ERR) {
-        return SLOTS_MGRT_ERR;
+    if (ret != SLOTS_MGRT_ERR
+        && (mgrtPipePush(ctx, &pipe, start_pos, n, n - start_pos)
+                == SLOTS_MGRT_ERR
+            || mgrtPipeDrain(ctx, &pipe) == SLOTS_MGRT_ERR)) {
+        ret = SLOTS_MGRT_ERR;
     }
+    mgrtPipeFree(&pipe);
+    return ret;
+}
 
-    return n;
+// SlotsMGRT_ParseFlags
+// mgrtType comma separated flags: withpipeline,withcompress,withbinary,
+// witheventloop,withshm; unknown flags are ignored
+int SlotsMGRT_ParseFlags(const char* mgrtType) {
+    int flags = 0;
+    const char* p = mgrtType;
+    while (p != NULL && *p != '\0') {
+        const char* end = strchr(p, ',');
+        size_t len = end != NULL ? (size_t)(end - p) : strlen(p);
+        if (len == 12 && strncasecmp(p, "withpipeline", len) == 0) {
+            flags |= SLOTS_MGRT_PIPELINE;
+        } else if (len == 12 && strncasecmp(p, "withcompress", len) == 0) {
+            flags |= SLOTS_MGRT_COMPRESS;
+        } else if (len == 10 && strncasecmp(p, "withbinary", len) == 0) {
+            flags |= SLOTS_MGRT_BINARY;
+        } else if (len == 13 && strncasecmp(p, "witheventloop", len) == 0) {
+            flags |= SLOTS_MGRT_EVENTLOOP;
+        } else if (len == 7 && strncasecmp(p, "withshm", len) == 0) {
+            // shm batches are slotsrestorebin batches
+            flags |= SLOTS_MGRT_SHM | SLOTS_MGRT_BINARY;
+        }
+        p = end != NULL ? end + 1 : NULL;
+    }
+    return flags;
 }
 
 // MGRT
 // batch migrate send to host:port with r/w timeout,
 // use withpipeline use redis self restore to migrate,
-// default with SlotsRestore.
+// use withcompress send lzf compressed dump vals with slotsrestorelzf,
+// use withbinary send binary batches with slotsrestorebin (can compress),
+// use withshm write binary batches into a shm ring, send slotsrestoreshm,
+// default with SlotsRestore, split send cmd params by batch_bytes.
 // return value:
 //    -1 - error happens
 //   >=0 - # of success migration (0 or n)
 static int MGRT(RedisModuleCtx* ctx, const sds host, const sds port,
-                time_t timeoutMS, rdb_dump_obj* objs[], int n, sds mgrtType) {
+                time_t timeoutMS, rdb_dump_obj* objs[], int n, sds mgrtType,
+                size_t batch_bytes) {
     int db = RedisModule_GetSelectedDb(ctx);
     struct timeval timeout
         = {.tv_sec = timeoutMS / 1000, .tv_usec = (timeoutMS % 1000) * 1000};
-    slot_mgrt_connet_meta meta
-        = {.db = db, .host = host, .port = port, .timeout = timeout};
+    int flags = SlotsMGRT_ParseFlags(mgrtType);
+    int compress = flags & SLOTS_MGRT_COMPRESS;
+    slot_mgrt_connet_meta meta = {.db = db,
+                                  .host = host,
+                                  .port = port,
+                                  .timeout = timeout,
+                                  .flags = flags};
 
     // if use thread pool, each worker thread new one connect to mgrt
     if (g_slots_meta_info.slots_mgrt_threads > 0) {
-        int ret = BatchSendWithThreadPool_SlotsRestore(ctx, &meta, objs, n);
+        int ret = BatchSendWithThreadPool_SlotsRestore(ctx, &meta, objs, n,
+                                                       batch_bytes);
         return ret;
     }
 
-    db_slot_mgrt_connect* conn = SlotsMGRT_GetConnCtx(ctx, &meta);
-    if (conn == NULL) {
-        return SLOTS_MGRT_ERR;
-    }
-    // todo auth
-
-    redisReply* rr;
-    rr = redisCommand(conn->conn_ctx, "SELECT %d", db);
-    if (rr == NULL || rr->type == REDIS_REPLY_ERROR) {
-        if (rr != NULL) {
-            freeReplyObject(rr);
-        }
-        SlotsMGRT_CloseConn(ctx, &meta);
+    // todo auth
+    db_slot_mgrt_connect* conn = SlotsMGRT_GetDbConn(ctx, &meta);
+    if (conn == NULL) {
         return SLOTS_MGRT_ERR;
     }
-    freeReplyObject(rr);
 
-    if (mgrtType != NULL && strcasecmp(mgrtType, "withpipeline") == 0
-        && !g_slots_meta_info.async) {
-        int ret = Pipeline_SlotsRestore(ctx, conn, objs, n);
-        SlotsMGRT_CloseConn(ctx, &meta);
+    if (flags & SLOTS_MGRT_PIPELINE) {
+        int ret = Pipeline_SlotsRestore(ctx, conn, objs, n, batch_bytes);
+        SlotsMGRT_ReleaseConn(ctx, conn, ret != SLOTS_MGRT_ERR);
         return ret;
     }
 
-    int ret = BatchSend_SlotsRestore(ctx, conn, objs, n);
-    SlotsMGRT_CloseConn(ctx, &meta);
+    int ret;
+    if (flags & SLOTS_MGRT_BINARY) {
+        ret = BatchSendBin_SlotsRestore(ctx, conn, objs, n, batch_bytes,
+                                        compress);
+    } else {
+        ret = BatchSend_SlotsRestore(ctx, conn, objs, n, batch_bytes,
+                                     compress);
+    }
+    SlotsMGRT_ReleaseConn(ctx, conn, ret != SLOTS_MGRT_ERR);
     return ret;
 }
 
-// dumpObj
+// doDumpObj
 // return 0 nothing todo -1 error happens; if dump ok, return a new dump obj
-static int dumpObj(RedisModuleCtx* ctx, RedisModuleString* key,
-                   rdb_dump_obj** obj) {
+static int doDumpObj(RedisModuleCtx* ctx, RedisModuleString* key,
+                     rdb_dump_obj** obj) {
     ASYNC_LOCK(ctx);
     RedisModuleCallReply* reply = RedisModule_Call(ctx, "DUMP", "s", key);
     ASYNC_UNLOCK(ctx);
@@ -747,10 +1273,19 @@ static int dumpObj(RedisModuleCtx* ctx, RedisModuleString* key,
     a_obj->key = key;
     a_obj->ttlms = ttlms;
     a_obj->val = val;
+    a_obj->rawlen = 0;
     *obj = a_obj;
     return 1;
 }
 
+static int dumpObj(RedisModuleCtx* ctx, RedisModuleString* key,
+                   rdb_dump_obj** obj) {
+    SLOTS_LATENCY_BEGIN(start);
+    int ret = doDumpObj(ctx, key, obj);
+    SLOTS_LATENCY_END(SLOTS_LATENCY_OP_DUMP, start);
+    return ret;
+}
+
 static void dumpObjTask(void* arg) {
     dump_obj_params* params = (dump_obj_params*)arg;
     RedisModuleCtx* ctx = RedisModule_GetThreadSafeContext(NULL);
@@ -772,6 +1307,7 @@ static int getRdbDumpObjsWithThreadPool(RedisModuleCtx* ctx,
     dump_obj_params* params = RedisModule_Alloc(sizeof(dump_obj_params) * n);
     threadpool thpool = thpool_init(num_threads);
     for (int i = 0; i < n; i++) {
+        objs[i] = NULL;
         params[i].key = keys[i];
         params[i].obj = &objs[i];
         params[i].result_code = SLOTS_MGRT_NOTHING;
@@ -780,26 +1316,33 @@ static int getRdbDumpObjsWithThreadPool(RedisModuleCtx* ctx,
     thpool_wait(thpool);
     thpool_destroy(thpool);
 
+    // compact dumped objs to the front
     int j = 0;
+    int err = 0;
     for (int i = 0; i < n; i++) {
-        if (params[i].result_code == SLOTS_MGRT_NOTHING)
-            continue;
         if (params[i].result_code == SLOTS_MGRT_ERR) {
-            RedisModule_Free(params);
-            return SLOTS_MGRT_ERR;
+            err = 1;
+        }
+        if (params[i].result_code != 1) {
+            continue;
+        }
+        if (i != j) {
+            objs[j] = objs[i];
+            objs[i] = NULL;
         }
         j++;
     }
 
     RedisModule_Free(params);
-    return j;
+    return err ? SLOTS_MGRT_ERR : j;
 }
 
 // SlotsMGRT_GetRdbDumpObjs
 // return value:
 //  -1 - error happens
 //  >=0 - # of success get rdb_dump_objs num (0 or n)
-// rdb_dump_obj* objs[] outsied alloc to fill rdb_dump_obj, use over to free.
+// rdb_dump_obj* objs[] outsied calloc to fill rdb_dump_obj from the front,
+// use over to free.
 static int getRdbDumpObjs(RedisModuleCtx* ctx, RedisModuleString* keys[], int n,
                           rdb_dump_obj** objs) {
     if (n <= 0) {
@@ -810,9 +1353,12 @@ static int getRdbDumpObjs(RedisModuleCtx* ctx, RedisModuleString* keys[], int n,
         return getRdbDumpObjsWithThreadPool(ctx, keys, n, objs);
     }
 
+    slots_yield y;
+    SlotsYield_Init(ctx, &y);
     int j = 0;
     for (int i = 0; i < n; i++) {
-        int r = dumpObj(ctx, keys[i], &objs[i]);
+        int r = dumpObj(ctx, keys[i], &objs[j]);
+        SlotsYield_Keys(&y, 1);
         if (r == SLOTS_MGRT_NOTHING)
             continue;
         if (r == SLOTS_MGRT_ERR)
@@ -822,29 +1368,103 @@ static int getRdbDumpObjs(RedisModuleCtx* ctx, RedisModuleString* keys[], int n,
     return j;
 }
 
+// SlotsYield_Init
+// long sync cmd (mgrt, slotsdel, restore) on the main thread can yield,
+// not async thread/thread pool workers, multi/lua, master or loading.
+void SlotsYield_Init(RedisModuleCtx* ctx, slots_yield* y) {
+    y->ctx = NULL;
+    y->keys = 0;
+    y->last_ns = 0;
+#ifdef REDISMODULE_YIELD_FLAG_CLIENTS
+    if (RedisModule_Yield == NULL
+        || (g_slots_meta_info.yield_keys <= 0
+            && g_slots_meta_info.yield_us <= 0)
+        || (g_slots_meta_info.async && !slots_async_inline)) {
+        return;
+    }
+    int flags = RedisModule_GetContextFlags(ctx);
+    if (flags
+        & (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA
+           | REDISMODULE_CTX_FLAGS_REPLICATED
+           | REDISMODULE_CTX_FLAGS_LOADING)) {
+        return;
+    }
+    y->ctx = ctx;
+    y->last_ns = SlotsLatency_NowNs();
+#else
+    UNUSED(ctx);
+#endif
+}
+
+// SlotsYield_Keys
+// after keys done, yield to the event loop every yield_keys keys or yield_us
+// us (redis >= 7.0): other clients get -BUSY after busy-reply-threshold
+// instead of waiting the whole cmd, keys can't be changed by them.
+void SlotsYield_Keys(slots_yield* y, int keys) {
+#ifdef REDISMODULE_YIELD_FLAG_CLIENTS
+    if (y->ctx == NULL) {
+        return;
+    }
+    y->keys += keys;
+    uint64_t now = SlotsLatency_NowNs();
+    if ((g_slots_meta_info.yield_keys > 0
+         && y->keys >= g_slots_meta_info.yield_keys)
+        || (g_slots_meta_info.yield_us > 0
+            && now - y->last_ns
+                   >= (uint64_t)g_slots_meta_info.yield_us * 1000)) {
+        slots_yielding = 1;
+        RedisModule_Yield(y->ctx, REDISMODULE_YIELD_FLAG_CLIENTS,
+                          "redisxslot slots mgrt/del/restore is running");
+        slots_yielding = 0;
+        y->keys = 0;
+        y->last_ns = SlotsLatency_NowNs();
+    }
+#else
+    UNUSED(y);
+    UNUSED(keys);
+#endif
+}
+
+// one UNLINK for the whole batch, propagated to replicas/AOF as one command
 static int delKeys(RedisModuleCtx* ctx, RedisModuleString* keys[], int n) {
-    RedisModuleCallReply* reply;
-    int ret = 0;
+    if (n <= 0)
+        return 0;
+    ASYNC_LOCK(ctx);
+    RedisModuleCallReply* reply
+        = RedisModule_Call(ctx, "UNLINK", "v!", keys, (size_t)n);
+    ASYNC_UNLOCK(ctx);
+    if (reply == NULL)
+        return 0;
+    int type = RedisModule_CallReplyType(reply);
+    RedisModule_FreeCallReply(reply);
+    if (type == REDISMODULE_REPLY_NULL)
+        return 0;
+    if (type != REDISMODULE_REPLY_INTEGER)
+        return SLOTS_MGRT_ERR;
+    return n;
+}
+
+// SlotsMGRT_DumpKeys
+// dump keys on the calling thread (no dump thread pool), fill objs from the
+// front, return dump objs num or SLOTS_MGRT_ERR
+int SlotsMGRT_DumpKeys(RedisModuleCtx* ctx, RedisModuleString* keys[], int n,
+                       rdb_dump_obj** objs) {
+    int j = 0;
     for (int i = 0; i < n; i++) {
-        ASYNC_LOCK(ctx);
-        // reply = RedisModule_Call(ctx, "DEL", "s", keys[i]);
-        reply = RedisModule_Call(ctx, "UNLINK", "s!", keys[i]);
-        ASYNC_UNLOCK(ctx);
-        int type = RedisModule_CallReplyType(reply);
-        if (reply == NULL)
-            continue;
-        if (type == REDISMODULE_REPLY_NULL) {
-            RedisModule_FreeCallReply(reply);
+        int r = dumpObj(ctx, keys[i], &objs[j]);
+        if (r == SLOTS_MGRT_NOTHING)
             continue;
-        }
-        if (type != REDISMODULE_REPLY_INTEGER) {
-            RedisModule_FreeCallReply(reply);
+        if (r == SLOTS_MGRT_ERR)
             return SLOTS_MGRT_ERR;
-        }
-        RedisModule_FreeCallReply(reply);
-        ret++;
+        j++;
     }
-    return ret;
+    return j;
+}
+
+// SlotsMGRT_DelKeys
+// unlink migrated keys as one command, return keys num or SLOTS_MGRT_ERR
+int SlotsMGRT_DelKeys(RedisModuleCtx* ctx, RedisModuleString* keys[], int n) {
+    return delKeys(ctx, keys, n);
 }
 
 void FreeDumpObjs(RedisModuleCtx* ctx, rdb_dump_obj** objs, int n) {
@@ -868,56 +1488,235 @@ static double get_us(struct timeval t) {
     return (t.tv_sec * 1000000 + t.tv_usec);
 }
 
-static int migrateKeys(RedisModuleCtx* ctx, const sds host, const sds port,
-                       time_t timeoutMS, RedisModuleString* keys[], int n,
-                       const sds mgrtType) {
-    if (n <= 0) {
-        return 0;
+// SlotsMGRT_LatencyHistAdd
+// add a cost(us) to the log2 buckets: le 1us, 2us, 4us, ... ,+inf
+void SlotsMGRT_LatencyHistAdd(slots_latency_hist* hist, double us) {
+    uint64_t v = us > 0 ? (uint64_t)us : 0;
+    int i = 0;
+    while (i < MGRT_LATENCY_HIST_BUCKETS - 1 && v > (1ULL << i)) {
+        i++;
+    }
+    __atomic_add_fetch(&hist->buckets[i], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->sum_us, v, __ATOMIC_RELAXED);
+}
+
+// SlotsMGRT_GetBatchSize
+// get current adaptive mgrt batch keys and split send cmd params bytes
+void SlotsMGRT_GetBatchSize(int* batch_keys, size_t* batch_bytes) {
+    pthread_mutex_lock(&slotsmgrt_batch_ctrl.lock);
+    if (batch_keys != NULL) {
+        *batch_keys = slotsmgrt_batch_ctrl.batch_keys;
+    }
+    if (batch_bytes != NULL) {
+        *batch_bytes = slotsmgrt_batch_ctrl.batch_bytes;
+    }
+    pthread_mutex_unlock(&slotsmgrt_batch_ctrl.lock);
+}
+
+// mgrtBatchFeedback
+// like tcp congestion window AIMD, use the batch measured dump/send/del cost:
+// cost <= budget, additive increase batch keys/bytes (only full batch);
+// cost > budget, multiplicative decrease (half) batch keys/bytes.
+static void mgrtBatchFeedback(RedisModuleCtx* ctx, int keys, int full_batch,
+                              double cost_us) {
+    int budget_us = g_slots_meta_info.mgrt_batch_budget_us;
+    if (budget_us <= 0 || keys <= 0) {
+        return;
     }
+
+    pthread_mutex_lock(&slotsmgrt_batch_ctrl.lock);
+    if (cost_us > budget_us) {
+        slotsmgrt_batch_ctrl.batch_keys /= 2;
+        if (slotsmgrt_batch_ctrl.batch_keys < MGRT_BATCH_KEYS_MIN) {
+            slotsmgrt_batch_ctrl.batch_keys = MGRT_BATCH_KEYS_MIN;
+        }
+        slotsmgrt_batch_ctrl.batch_bytes /= 2;
+        if (slotsmgrt_batch_ctrl.batch_bytes < MGRT_BATCH_BYTES_MIN) {
+            slotsmgrt_batch_ctrl.batch_bytes = MGRT_BATCH_BYTES_MIN;
+        }
+    } else if (full_batch) {
+        slotsmgrt_batch_ctrl.batch_keys += MGRT_BATCH_KEYS_INCR;
+        if (slotsmgrt_batch_ctrl.batch_keys > MGRT_BATCH_KEYS_MAX) {
+            slotsmgrt_batch_ctrl.batch_keys = MGRT_BATCH_KEYS_MAX;
+        }
+        slotsmgrt_batch_ctrl.batch_bytes += MGRT_BATCH_BYTES_INCR;
+        if (slotsmgrt_batch_ctrl.batch_bytes > MGRT_BATCH_BYTES_MAX) {
+            slotsmgrt_batch_ctrl.batch_bytes = MGRT_BATCH_BYTES_MAX;
+        }
+    }
+    int batch_keys = slotsmgrt_batch_ctrl.batch_keys;
+    size_t batch_bytes = slotsmgrt_batch_ctrl.batch_bytes;
+    pthread_mutex_unlock(&slotsmgrt_batch_ctrl.lock);
+
+    RedisModule_Log(ctx, "verbose",
+                    "%d keys batch cost %f us budget %d us, next batch keys %d "
+                    "bytes %zu",
+                    keys, cost_us, budget_us, batch_keys, batch_bytes);
+}
+
+// migrateBatchKeys
+// dump -> mgrt -> del one batch keys, return del keys num or -1 error happens
+static int migrateBatchKeys(RedisModuleCtx* ctx, const sds host,
+                            const sds port, time_t timeoutMS,
+                            RedisModuleString* keys[], int n,
+                            const sds mgrtType, size_t batch_bytes) {
     struct timeval start_time, stop_time;
+    double cost_us;
+    MGRT_STATS_INCR(batches, 1);
+    MGRT_STATS_INCR(inflight_batches, 1);
 
     // get rdb dump objs
     gettimeofday(&start_time, NULL);
-    rdb_dump_obj** objs = RedisModule_Alloc(sizeof(rdb_dump_obj*) * n);
+    rdb_dump_obj** objs = RedisModule_Calloc(n, sizeof(rdb_dump_obj*));
     int ret = getRdbDumpObjs(ctx, keys, n, objs);
     if (ret == SLOTS_MGRT_NOTHING) {
-        FreeDumpObjs(ctx, objs, ret);
+        FreeDumpObjs(ctx, objs, n);
+        MGRT_STATS_DECR(inflight_batches, 1);
         return 0;
     }
     if (ret == SLOTS_MGRT_ERR) {
-        FreeDumpObjs(ctx, objs, ret);
+        FreeDumpObjs(ctx, objs, n);
+        MGRT_STATS_INCR(dump_errors, 1);
+        MGRT_STATS_DECR(inflight_batches, 1);
         return SLOTS_MGRT_ERR;
     }
     gettimeofday(&stop_time, NULL);
-    RedisModule_Log(ctx, "notice", "%d objs dump cost %f ms", ret,
-                    (get_us(stop_time) - get_us(start_time)) / 1000);
+    cost_us = get_us(stop_time) - get_us(start_time);
+    SlotsMGRT_LatencyHistAdd(&g_slots_mgrt_stats.dump_latency, cost_us);
+    RedisModule_Log(ctx, "verbose", "%d objs dump cost %f ms", ret,
+                    cost_us / 1000);
+
+    size_t bytes = 0;
+    for (int i = 0; i < ret; i++) {
+        size_t ksz, vsz;
+        RedisModule_StringPtrLen(objs[i]->key, &ksz);
+        RedisModule_StringPtrLen(objs[i]->val, &vsz);
+        bytes += ksz + vsz;
+    }
 
     // migrate
     gettimeofday(&start_time, NULL);
-    int m_ret = MGRT(ctx, host, port, timeoutMS, objs, ret, mgrtType);
+    int m_ret
+        = MGRT(ctx, host, port, timeoutMS, objs, ret, mgrtType, batch_bytes);
+    FreeDumpObjs(ctx, objs, ret);
     if (m_ret == SLOTS_MGRT_ERR) {
-        FreeDumpObjs(ctx, objs, ret);
+        MGRT_STATS_INCR(send_errors, 1);
+        MGRT_STATS_DECR(inflight_batches, 1);
         return SLOTS_MGRT_ERR;
     }
     if (m_ret == 0) {
-        FreeDumpObjs(ctx, objs, ret);
+        MGRT_STATS_DECR(inflight_batches, 1);
         return m_ret;
     }
-    FreeDumpObjs(ctx, objs, ret);
     gettimeofday(&stop_time, NULL);
-    RedisModule_Log(ctx, "notice", "%d objs mgrt cost %f ms", m_ret,
-                    (get_us(stop_time) - get_us(start_time)) / 1000);
+    cost_us = get_us(stop_time) - get_us(start_time);
+    SlotsMGRT_LatencyHistAdd(&g_slots_mgrt_stats.send_latency, cost_us);
+    MGRT_STATS_INCR(keys_migrated, m_ret);
+    MGRT_STATS_INCR(bytes_migrated, bytes);
+    RedisModule_Log(ctx, "verbose", "%d objs mgrt cost %f ms", m_ret,
+                    cost_us / 1000);
 
     // del (unlink async del)
     gettimeofday(&start_time, NULL);
     ret = delKeys(ctx, keys, n);
+    MGRT_STATS_DECR(inflight_batches, 1);
     if (ret == SLOTS_MGRT_ERR) {
+        MGRT_STATS_INCR(del_errors, 1);
         return SLOTS_MGRT_ERR;
     }
     gettimeofday(&stop_time, NULL);
-    RedisModule_Log(ctx, "notice", "%d keys del cost %f ms", ret,
-                    (get_us(stop_time) - get_us(start_time)) / 1000);
+    cost_us = get_us(stop_time) - get_us(start_time);
+    SlotsMGRT_LatencyHistAdd(&g_slots_mgrt_stats.del_latency, cost_us);
+    MGRT_STATS_INCR(keys_deleted, ret);
+    RedisModule_Log(ctx, "verbose", "%d keys del cost %f ms", ret,
+                    cost_us / 1000);
+
+    return ret;
+}
+
+// migrateKeysBatches
+// split keys to batches with adaptive batch size if set mgrt_batch_budget_us,
+// otherwise one batch (all keys), split send cmd params size 1M.
+// return migrated keys num, a batch err after some batches migrated return
+// them (not SLOTS_MGRT_ERR).
+static int migrateKeysBatches(RedisModuleCtx* ctx, const sds host,
+                              const sds port, time_t timeoutMS,
+                              RedisModuleString* keys[], int n,
+                              const sds mgrtType) {
+    if (g_slots_meta_info.mgrt_batch_budget_us <= 0) {
+        return migrateBatchKeys(ctx, host, port, timeoutMS, keys, n, mgrtType,
+                                REDIS_MGRT_CMD_PARAMS_SIZE);
+    }
+
+    struct timeval start_time, stop_time;
+    slots_yield y;
+    SlotsYield_Init(ctx, &y);
+    int total = 0;
+    for (int pos = 0; pos < n;) {
+        int batch_keys;
+        size_t batch_bytes;
+        SlotsMGRT_GetBatchSize(&batch_keys, &batch_bytes);
+        int cn = n - pos < batch_keys ? n - pos : batch_keys;
+
+        gettimeofday(&start_time, NULL);
+        int ret = migrateBatchKeys(ctx, host, port, timeoutMS, keys + pos, cn,
+                                   mgrtType, batch_bytes);
+        if (ret == SLOTS_MGRT_ERR) {
+            if (total == 0) {
+                return SLOTS_MGRT_ERR;
+            }
+            // not atomic: the batches before are restored on target and del
+            // on source (a tag group is split), return them, the left keys
+            // are retried by the next mgrt
+            RedisModule_Log(ctx, "warning",
+                            "slotsmgrt: batch err after %d keys migrated, "
+                            "%d keys left",
+                            total, n - pos);
+            return total;
+        }
+        gettimeofday(&stop_time, NULL);
+        mgrtBatchFeedback(ctx, cn, cn == batch_keys,
+                          get_us(stop_time) - get_us(start_time));
 
+        total += ret;
+        pos += cn;
+        SlotsYield_Keys(&y, cn);
+    }
+
+    return total;
+}
+
+// migrateKeys
+// async block thread: keys are owned by the slot index and kept by the
+// epoch, copy them and leave the epoch while dump/send/del (network round
+// trips), keys del meanwhile are freed by the cron instead of the cmd done.
+static int migrateKeys(RedisModuleCtx* ctx, const sds host, const sds port,
+                       time_t timeoutMS, RedisModuleString* keys[], int n,
+                       const sds mgrtType) {
+    if (n <= 0) {
+        return 0;
+    }
+    if (!SlotsEpoch_Held()) {
+        return migrateKeysBatches(ctx, host, port, timeoutMS, keys, n,
+                                  mgrtType);
+    }
+
+    RedisModuleString** owned
+        = RedisModule_Alloc(sizeof(RedisModuleString*) * n);
+    for (int i = 0; i < n; i++) {
+        owned[i] = RedisModule_CreateStringFromString(ctx, keys[i]);
+    }
+    SlotsEpoch_Exit();
+    int ret = migrateKeysBatches(ctx, host, port, timeoutMS, owned, n,
+                                 mgrtType);
+    ASYNC_LOCK(ctx);
+    for (int i = 0; i < n; i++) {
+        RedisModule_FreeString(ctx, owned[i]);
+    }
+    ASYNC_UNLOCK(ctx);
+    RedisModule_Free(owned);
+    SlotsEpoch_Enter();
     return ret;
 }
 
@@ -970,17 +1769,32 @@ static void notifyOne(RedisModuleCtx* ctx, RedisModuleString* key) {
     ASYNC_UNLOCK(ctx);
 }
 
-static int restoreOneWithReplace(RedisModuleCtx* ctx, rdb_dump_obj* obj) {
-    if (obj->ttlms < 0) {
-        obj->ttlms = 0;
+// restore a dump payload (lzf compressed if rawlen > 0) with replace,
+// key for the slotsmgrt-restore notify, NULL to create it from k
+static int restoreDumpWithReplace(RedisModuleCtx* ctx, RedisModuleString* key,
+                                  const char* k, size_t klen, time_t ttlms,
+                                  const char* v, size_t vsz, size_t rawlen) {
+    if (ttlms < 0) {
+        ttlms = 0;
+    }
+    // slotsrestorelzf/bin val, decompress out of the GIL (async/pool thread)
+    char* raw = NULL;
+    if (rawlen > 0) {
+        raw = RedisModule_Alloc(rawlen);
+        if (m_lzf_decompress(v, vsz, raw, rawlen) != rawlen) {
+            RedisModule_Free(raw);
+            return SLOTS_MGRT_ERR;
+        }
+        v = raw;
+        vsz = rawlen;
     }
-    const char* k = RedisModule_StringPtrLen(obj->key, NULL);
-    size_t vsz;
-    const char* v = RedisModule_StringPtrLen(obj->val, &vsz);
     ASYNC_LOCK(ctx);
     RedisModuleCallReply* reply = RedisModule_Call(
-        ctx, "RESTORE", "clbc", k, obj->ttlms, v, vsz, "replace");
+        ctx, "RESTORE", "blbc", k, klen, (long long)ttlms, v, vsz, "replace");
     ASYNC_UNLOCK(ctx);
+    if (raw != NULL) {
+        RedisModule_Free(raw);
+    }
     if (reply == NULL) {
         return 0;
     }
@@ -994,32 +1808,111 @@ static int restoreOneWithReplace(RedisModuleCtx* ctx, rdb_dump_obj* obj) {
         return SLOTS_MGRT_ERR;
     }
 
-    notifyOne(ctx, obj->key);
+    if (key != NULL) {
+        notifyOne(ctx, key);
+    } else {
+        RedisModuleString* skey = RedisModule_CreateString(ctx, k, klen);
+        notifyOne(ctx, skey);
+        RedisModule_FreeString(ctx, skey);
+    }
     RedisModule_FreeCallReply(reply);
 
     return 1;
 }
 
-static int restoreMutli(RedisModuleCtx* ctx, rdb_dump_obj* objs[], int n) {
+static int restoreOneWithReplace(RedisModuleCtx* ctx, rdb_dump_obj* obj) {
+    SLOTS_LATENCY_BEGIN(start);
+    size_t klen, vsz;
+    const char* k = RedisModule_StringPtrLen(obj->key, &klen);
+    const char* v = RedisModule_StringPtrLen(obj->val, &vsz);
+    int ret = restoreDumpWithReplace(ctx, obj->key, k, klen, obj->ttlms, v,
+                                     vsz, obj->rawlen);
+    SLOTS_LATENCY_END(SLOTS_LATENCY_OP_RESTORE, start);
+    return ret;
+}
+
+static int restoreRecordWithReplace(RedisModuleCtx* ctx,
+                                    slots_batch_record* rec) {
+    SLOTS_LATENCY_BEGIN(start);
+    int ret = restoreDumpWithReplace(ctx, NULL, rec->key, rec->klen,
+                                     rec->ttlms, rec->val, rec->vlen,
+                                     rec->rawlen);
+    SLOTS_LATENCY_END(SLOTS_LATENCY_OP_RESTORE, start);
+    return ret;
+}
+
+// the inner RESTOREs are not propagated and the caller replicates the whole
+// batch only if all keys are restored, on err replicate the restored ones
+// (codes[i] == 1), replicas/AOF must have the keys kept on master
+static void replicateRestored(RedisModuleCtx* ctx, rdb_dump_obj* objs[],
+                              slots_batch_record* recs, const int* codes,
+                              int n) {
+    ASYNC_LOCK(ctx);
+    for (int i = 0; i < n; i++) {
+        if (codes[i] != 1) {
+            continue;
+        }
+        if (objs != NULL) {
+            rdb_dump_obj* obj = objs[i];
+            if (obj->rawlen > 0) {
+                RedisModule_Replicate(ctx, "SLOTSRESTORELZF", "slls",
+                                      obj->key, (long long)obj->ttlms,
+                                      (long long)obj->rawlen, obj->val);
+            } else {
+                RedisModule_Replicate(ctx, "SLOTSRESTORE", "sls", obj->key,
+                                      (long long)obj->ttlms, obj->val);
+            }
+            continue;
+        }
+        slots_batch_record* rec = &recs[i];
+        if (rec->rawlen > 0) {
+            RedisModule_Replicate(ctx, "SLOTSRESTORELZF", "bllb", rec->key,
+                                  rec->klen, (long long)rec->ttlms,
+                                  (long long)rec->rawlen, rec->val, rec->vlen);
+        } else {
+            RedisModule_Replicate(ctx, "SLOTSRESTORE", "blb", rec->key,
+                                  rec->klen, (long long)rec->ttlms, rec->val,
+                                  rec->vlen);
+        }
+    }
+    ASYNC_UNLOCK(ctx);
+}
+
+// restore objs, or recs if objs is NULL
+static int restoreMutli(RedisModuleCtx* ctx, rdb_dump_obj* objs[],
+                        slots_batch_record* recs, int n) {
+    slots_yield y;
+    SlotsYield_Init(ctx, &y);
+    int* codes = RedisModule_Alloc(sizeof(int) * n);
     for (int i = 0; i < n; i++) {
-        if (restoreOneWithReplace(ctx, objs[i]) == SLOTS_MGRT_ERR) {
+        codes[i] = objs != NULL ? restoreOneWithReplace(ctx, objs[i])
+                                : restoreRecordWithReplace(ctx, &recs[i]);
+        if (codes[i] == SLOTS_MGRT_ERR) {
+            replicateRestored(ctx, objs, recs, codes, i);
+            RedisModule_Free(codes);
             return SLOTS_MGRT_ERR;
         }
+        SlotsYield_Keys(&y, 1);
     }
 
+    RedisModule_Free(codes);
     return n;
 }
 
 static void restoreOneTask(void* arg) {
     RedisModuleCtx* ctx = RedisModule_GetThreadSafeContext(NULL);
     slots_restore_one_task_params* params = (slots_restore_one_task_params*)arg;
-    params->result_code = restoreOneWithReplace(ctx, params->obj);
+    if (params->obj != NULL) {
+        params->result_code = restoreOneWithReplace(ctx, params->obj);
+    } else {
+        params->result_code = restoreRecordWithReplace(ctx, params->rec);
+    }
     RedisModule_FreeThreadSafeContext(ctx);
 }
 
+// restore objs, or recs if objs is NULL
 static int restoreMutliWithThreadPool(RedisModuleCtx* ctx, rdb_dump_obj* objs[],
-                                      int n) {
-    UNUSED(ctx);
+                                      slots_batch_record* recs, int n) {
     // use redis dep's jemalloc allcator instead of libc allocator (often
     // prevents fragmentation problems)
     slots_restore_one_task_params* params
@@ -1030,7 +1923,8 @@ static int restoreMutliWithThreadPool(RedisModuleCtx* ctx, rdb_dump_obj* objs[],
 
     threadpool thpool = thpool_init(g_slots_meta_info.slots_restore_threads);
     for (int i = 0; i < n; i++) {
-        params[i].obj = objs[i];
+        params[i].obj = objs != NULL ? objs[i] : NULL;
+        params[i].rec = objs != NULL ? NULL : &recs[i];
         params[i].result_code = 0;
         thpool_add_work(thpool, restoreOneTask, (void*)&params[i]);
     }
@@ -1039,6 +1933,12 @@ static int restoreMutliWithThreadPool(RedisModuleCtx* ctx, rdb_dump_obj* objs[],
 
     for (int i = 0; i < n; i++) {
         if (params[i].result_code == SLOTS_MGRT_ERR) {
+            int* codes = RedisModule_Alloc(sizeof(int) * n);
+            for (int j = 0; j < n; j++) {
+                codes[j] = params[j].result_code;
+            }
+            replicateRestored(ctx, objs, recs, codes, n);
+            RedisModule_Free(codes);
             RedisModule_Free(params);
             // free(params);
             return SLOTS_MGRT_ERR;
@@ -1051,25 +1951,81 @@ static int restoreMutliWithThreadPool(RedisModuleCtx* ctx, rdb_dump_obj* objs[],
 }
 
 int SlotsMGRT_Restore(RedisModuleCtx* ctx, rdb_dump_obj* objs[], int n) {
+    int ret;
+    if (g_slots_meta_info.slots_restore_threads > 0) {
+        ret = restoreMutliWithThreadPool(ctx, objs, NULL, n);
+    } else {
+        ret = restoreMutli(ctx, objs, NULL, n);
+    }
+    if (ret == SLOTS_MGRT_ERR) {
+        MGRT_STATS_INCR(restore_errors, 1);
+        return ret;
+    }
+
+    size_t bytes = 0;
+    for (int i = 0; i < n; i++) {
+        size_t ksz, vsz;
+        RedisModule_StringPtrLen(objs[i]->key, &ksz);
+        RedisModule_StringPtrLen(objs[i]->val, &vsz);
+        bytes += ksz + vsz;
+    }
+    MGRT_STATS_INCR(keys_restored, ret);
+    MGRT_STATS_INCR(bytes_restored, bytes);
+    return ret;
+}
+
+// SlotsMGRT_RestoreBatch
+// check and restore a slotsrestorebin batch, records are decoded in place
+// return restored keys num, SLOTS_MGRT_ERR if invalid batch or restore err
+int SlotsMGRT_RestoreBatch(RedisModuleCtx* ctx, const char* buf, size_t len) {
+    int n = SlotsBatch_Check(buf, len);
+    if (n < 0) {
+        RedisModule_Log(ctx, "warning", "invalid slotsrestorebin batch");
+        MGRT_STATS_INCR(restore_errors, 1);
+        return SLOTS_MGRT_ERR;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    slots_batch_record* recs
+        = RedisModule_Alloc(sizeof(slots_batch_record) * n);
+    size_t pos = SLOTS_BATCH_HDR_SIZE;
+    for (int i = 0; i < n; i++) {
+        pos = SlotsBatch_Read(buf, pos, &recs[i]);
+    }
+    int ret;
     if (g_slots_meta_info.slots_restore_threads > 0) {
-        return restoreMutliWithThreadPool(ctx, objs, n);
+        ret = restoreMutliWithThreadPool(ctx, NULL, recs, n);
+    } else {
+        ret = restoreMutli(ctx, NULL, recs, n);
+    }
+    RedisModule_Free(recs);
+    if (ret == SLOTS_MGRT_ERR) {
+        MGRT_STATS_INCR(restore_errors, 1);
+        return ret;
     }
-    return restoreMutli(ctx, objs, n);
+
+    MGRT_STATS_INCR(keys_restored, ret);
+    MGRT_STATS_INCR(bytes_restored, len);
+    return ret;
 }
 
 int SlotsMGRT_SlotOneKey(RedisModuleCtx* ctx, const char* host,
                          const char* port, time_t timeout, int slot,
                          const char* mgrtType, int* left) {
     int db = RedisModule_GetSelectedDb(ctx);
-    pthread_rwlock_rdlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    // random key may do a rehash step; the entry may be freed after unlock,
+    // the key is kept by the epoch (async) or the GIL
+    SLOTKEY_TABLE_WRLOCK(db, slot);
     const m_dictEntry* de
         = m_dictGetRandomKey(db_slot_infos[db].slotkey_tables[slot]);
-    pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
-    if (de == NULL) {
+    RedisModuleString* key = de != NULL ? dictGetKey(de) : NULL;
+    SLOTKEY_TABLE_UNLOCK(db, slot);
+    if (key == NULL) {
         return 0;
     }
 
-    RedisModuleString* key = dictGetKey(de);
     int ret = SlotsMGRT_OneKey(ctx, host, port, timeout, key, mgrtType);
     if (ret == SLOTS_MGRT_ERR) {
         return SLOTS_MGRT_ERR;
@@ -1079,33 +2035,16 @@ int SlotsMGRT_SlotOneKey(RedisModuleCtx* ctx, const char* host,
         // m_dictDelete(db_slot_infos[db].slotkey_tables[slot], k);
     }
     if (left != NULL) {
-        pthread_rwlock_rdlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+        SLOTKEY_TABLE_RDLOCK(db, slot);
         *left = dictSize(db_slot_infos[db].slotkey_tables[slot]);
-        pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+        SLOTKEY_TABLE_UNLOCK(db, slot);
     }
     return ret;
 }
 
-int SlotsMGRT_TagKeys(RedisModuleCtx* ctx, const char* host, const char* port,
-                      time_t timeout, RedisModuleString* key,
-                      const char* mgrtType, int* left) {
-    const char* k = RedisModule_StringPtrLen(key, NULL);
-    uint32_t crc;
-    int hastag;
-    int slot = slots_num(k, &crc, &hastag);
-    if (!hastag) {
-        return SlotsMGRT_OneKey(ctx, host, port, timeout, key, mgrtType);
-    }
-
-    int db = RedisModule_GetSelectedDb(ctx);
-    pthread_rwlock_rdlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
-    dict* d = db_slot_infos[db].slotkey_tables[slot];
-    unsigned long s = dictSize(d);
-    pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
-    if (s == 0) {
-        return 0;
-    }
-
+// get keys with the same tag (crc) from the db tagged key list,
+// return keys num, *keys alloced if > 0
+static int getTagKeys(int db, uint32_t crc, RedisModuleString*** keys) {
     m_zrangespec range;
     range.min = (long long)crc;
     range.minex = 0;
@@ -1116,43 +2055,74 @@ int SlotsMGRT_TagKeys(RedisModuleCtx* ctx, const char* host, const char* port,
     list* l = m_listCreate();
 
     // like read current snapshot, but not iter
-    pthread_rwlock_rdlock(&(db_slot_infos[db].tagged_key_list_rwlock));
+    TAGGED_KEY_LIST_RDLOCK(db);
     m_zskiplistNode* node
         = m_zslFirstInRange(db_slot_infos[db].tagged_key_list, &range);
     while (node != NULL && node->score == (long long)crc) {
         m_listAddNodeTail(l, node->member);
         node = node->level[0].forward;
     }
-    pthread_rwlock_unlock(&(db_slot_infos[db].tagged_key_list_rwlock));
+    TAGGED_KEY_LIST_UNLOCK(db);
 
     int max = listLength(l);
     if (max == 0) {
         m_listRelease(l);
         return 0;
     }
-    RedisModuleString** keys
-        = RedisModule_Alloc(sizeof(RedisModuleString*) * max);
+    *keys = RedisModule_Alloc(sizeof(RedisModuleString*) * max);
     int n = 0;
     for (int i = 0; i < max; i++) {
         m_listNode* head = listFirst(l);
         if (head != NULL) {
             RedisModuleString* k = listNodeValue(head);
             if (k != NULL) {
-                keys[n] = k;
+                (*keys)[n] = k;
                 n++;
             }
         }
         m_listDelNode(l, head);
     }
     m_listRelease(l);
+    if (n == 0) {
+        RedisModule_Free(*keys);
+        *keys = NULL;
+    }
+    return n;
+}
+
+int SlotsMGRT_TagKeys(RedisModuleCtx* ctx, const char* host, const char* port,
+                      time_t timeout, RedisModuleString* key,
+                      const char* mgrtType, int* left) {
+    const char* k = RedisModule_StringPtrLen(key, NULL);
+    uint32_t crc;
+    int hastag;
+    int slot = slots_num(k, &crc, &hastag);
+    if (!hastag) {
+        return SlotsMGRT_OneKey(ctx, host, port, timeout, key, mgrtType);
+    }
+
+    int db = RedisModule_GetSelectedDb(ctx);
+    SLOTKEY_TABLE_RDLOCK(db, slot);
+    dict* d = db_slot_infos[db].slotkey_tables[slot];
+    unsigned long s = dictSize(d);
+    SLOTKEY_TABLE_UNLOCK(db, slot);
+    if (s == 0) {
+        return 0;
+    }
+
+    RedisModuleString** keys = NULL;
+    int n = getTagKeys(db, crc, &keys);
+    if (n == 0) {
+        return 0;
+    }
 
     int ret = migrateKeys(ctx, (const sds)host, (const sds)port, timeout, keys,
                           n, (const sds)mgrtType);
     RedisModule_Free(keys);
     if (left != NULL) {
-        pthread_rwlock_rdlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+        SLOTKEY_TABLE_RDLOCK(db, slot);
         *left = dictSize(db_slot_infos[db].slotkey_tables[slot]);
-        pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+        SLOTKEY_TABLE_UNLOCK(db, slot);
     }
     return ret;
 }
@@ -1161,14 +2131,17 @@ int SlotsMGRT_TagSlotKeys(RedisModuleCtx* ctx, const char* host,
                           const char* port, time_t timeout, int slot,
                           const char* mgrtType, int* left) {
     int db = RedisModule_GetSelectedDb(ctx);
-    pthread_rwlock_rdlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    // random key may do a rehash step; the entry may be freed after unlock,
+    // the key is kept by the epoch (async) or the GIL
+    SLOTKEY_TABLE_WRLOCK(db, slot);
     const m_dictEntry* de
         = m_dictGetRandomKey(db_slot_infos[db].slotkey_tables[slot]);
-    pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
-    if (de == NULL) {
+    RedisModuleString* key = de != NULL ? dictGetKey(de) : NULL;
+    SLOTKEY_TABLE_UNLOCK(db, slot);
+    if (key == NULL) {
         return 0;
     }
-    RedisModuleString* key = dictGetKey(de);
+
     int ret = SlotsMGRT_TagKeys(ctx, host, port, timeout, key, mgrtType, left);
     if (ret > 0) {
         // should sub cron_loop(server loop) to del
@@ -1177,6 +2150,46 @@ int SlotsMGRT_TagSlotKeys(RedisModuleCtx* ctx, const char* host,
     return ret;
 }
 
+// SlotsMGRT_GetMgrtKeys
+// collect the keys a slotsmgrt* cmd migrate: key, or a random key of the
+// slot if key is NULL; withtag add the keys with the same tag.
+// return keys num, *keys alloced if > 0, keys are owned by the slot index
+int SlotsMGRT_GetMgrtKeys(RedisModuleCtx* ctx, int slot,
+                          RedisModuleString* key, int withtag,
+                          RedisModuleString*** keys) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    if (key == NULL) {
+        SLOTKEY_TABLE_WRLOCK(db, slot);
+        const m_dictEntry* de
+            = m_dictGetRandomKey(db_slot_infos[db].slotkey_tables[slot]);
+        key = de != NULL ? dictGetKey(de) : NULL;
+        SLOTKEY_TABLE_UNLOCK(db, slot);
+        if (key == NULL) {
+            return 0;
+        }
+    }
+
+    if (withtag) {
+        uint32_t crc;
+        int hastag;
+        const char* k = RedisModule_StringPtrLen(key, NULL);
+        slot = slots_num(k, &crc, &hastag);
+        if (hastag) {
+            SLOTKEY_TABLE_RDLOCK(db, slot);
+            unsigned long s = dictSize(db_slot_infos[db].slotkey_tables[slot]);
+            SLOTKEY_TABLE_UNLOCK(db, slot);
+            if (s == 0) {
+                return 0;
+            }
+            return getTagKeys(db, crc, keys);
+        }
+    }
+
+    *keys = RedisModule_Alloc(sizeof(RedisModuleString*));
+    (*keys)[0] = key;
+    return 1;
+}
+
 static void slotsScanRedisModuleKeyCallback(void* l, const m_dictEntry* de) {
     RedisModuleString* key = dictGetKey(de);
     m_listAddNodeTail((list*)l, key);
@@ -1185,52 +2198,61 @@ static void slotsScanRedisModuleKeyCallback(void* l, const m_dictEntry* de) {
 unsigned long SlotsMGRT_Scan(RedisModuleCtx* ctx, int slot, unsigned long count,
                              unsigned long cursor, list* l) {
     int db = RedisModule_GetSelectedDb(ctx);
-    pthread_rwlock_rdlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    SLOTKEY_TABLE_RDLOCK(db, slot);
     dict* d = db_slot_infos[db].slotkey_tables[slot];
-    pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    SLOTKEY_TABLE_UNLOCK(db, slot);
     long loops = count * 10;  // see dictScan
     do {
-        pthread_rwlock_rdlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+        SLOTKEY_TABLE_RDLOCK(db, slot);
         cursor
             = m_dictScan(d, cursor, slotsScanRedisModuleKeyCallback, NULL, l);
-        pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+        SLOTKEY_TABLE_UNLOCK(db, slot);
         loops--;
     } while (cursor != 0 && loops > 0 && listLength(l) < count);
     return cursor;
 }
 
 int SlotsMGRT_DelSlotKeys(RedisModuleCtx* ctx, int db, int slots[], int n) {
+    slots_yield y;
+    SlotsYield_Init(ctx, &y);
     for (int i = 0; i < n; i++) {
-        pthread_rwlock_rdlock(
-            &(db_slot_infos[db].slotkey_table_rwlocks[slots[i]]));
+        SLOTKEY_TABLE_RDLOCK(db, slots[i]);
         dict* d = db_slot_infos[db].slotkey_tables[slots[i]];
         int s = dictSize(d);
-        pthread_rwlock_unlock(
-            &(db_slot_infos[db].slotkey_table_rwlocks[slots[i]]));
+        SLOTKEY_TABLE_UNLOCK(db, slots[i]);
         if (s == 0) {
             continue;
         }
         list* l = m_listCreate();
         unsigned long cursor = 0;
         do {
-            pthread_rwlock_rdlock(
-                &(db_slot_infos[db].slotkey_table_rwlocks[slots[i]]));
+            SLOTKEY_TABLE_RDLOCK(db, slots[i]);
             cursor = m_dictScan(d, cursor, slotsScanRedisModuleKeyCallback,
                                 NULL, l);
-            pthread_rwlock_unlock(
-                &(db_slot_infos[db].slotkey_table_rwlocks[slots[i]]));
-            while (1) {
-                m_listNode* head = listFirst(l);
-                if (head == NULL) {
-                    break;
+            SLOTKEY_TABLE_UNLOCK(db, slots[i]);
+            // unlink the scan step keys as one command (one replicated
+            // UNLINK per step instead of per key)
+            int dels = (int)listLength(l);
+            if (dels > 0) {
+                RedisModuleString** keys
+                    = RedisModule_Alloc(sizeof(RedisModuleString*) * dels);
+                m_listIter li;
+                m_listNode* ln;
+                int j = 0;
+                m_listRewind(l, &li);
+                while ((ln = m_listNext(&li)) != NULL) {
+                    keys[j++] = listNodeValue(ln);
                 }
-                RedisModuleString* key = listNodeValue(head);
-                if (delKeys(ctx, (RedisModuleString*[]){key}, 1)
-                    == SLOTS_MGRT_ERR) {
+                int ret = delKeys(ctx, keys, dels);
+                RedisModule_Free(keys);
+                m_listEmpty(l);
+                if (ret == SLOTS_MGRT_ERR) {
+                    m_listRelease(l);
                     return SLOTS_MGRT_ERR;
                 }
-                m_listDelNode(l, head);
             }
+            // yield after the scanned keys are del, the list is empty
+            SlotsYield_Keys(&y, dels);
         } while (cursor != 0);
         m_listRelease(l);
     }
@@ -1279,7 +2301,91 @@ RedisModuleString* takeAndRef(RedisModuleCtx* ctx, RedisModuleString* str) {
     return str;
 }
 
-void Slots_Add(RedisModuleCtx* ctx, int db, RedisModuleString* key) {
+// relaxed atomic ops on slot index counters and bitmaps, plain ops when
+// slot_locking is off (single threaded index)
+static inline uint32_t slotsAddU32(uint32_t* p, int32_t v) {
+    if (g_slots_meta_info.slot_locking) {
+        return __atomic_add_fetch(p, v, __ATOMIC_RELAXED);
+    }
+    return *p += v;
+}
+
+static inline uint64_t slotsFetchOrU64(uint64_t* p, uint64_t v) {
+    if (g_slots_meta_info.slot_locking) {
+        return __atomic_fetch_or(p, v, __ATOMIC_RELAXED);
+    }
+    uint64_t old = *p;
+    *p = old | v;
+    return old;
+}
+
+static inline uint64_t slotsFetchAndU64(uint64_t* p, uint64_t v) {
+    if (g_slots_meta_info.slot_locking) {
+        return __atomic_fetch_and(p, v, __ATOMIC_RELAXED);
+    }
+    uint64_t old = *p;
+    *p = old & v;
+    return old;
+}
+
+// slot keys count and occupancy bit, call with the slot wrlock held;
+// diff slots share a bitmap word, so bit or/and must be atomic.
+static inline void slotKeyCountIncr(int db, int slot) {
+    if (slotsAddU32(&db_slot_infos[db].slot_key_counts[slot], 1) == 1) {
+        slotsFetchOrU64(&db_slot_infos[db].slot_bitmap[slot >> 6],
+                        1ULL << (slot & 63));
+    }
+}
+
+static inline void slotKeyCountDecr(int db, int slot) {
+    if (slotsAddU32(&db_slot_infos[db].slot_key_counts[slot], -1) == 0) {
+        slotsFetchAndU64(&db_slot_infos[db].slot_bitmap[slot >> 6],
+                         ~(1ULL << (slot & 63)));
+    }
+}
+
+// slotMarkDirty
+// mark the slot for cron resize/rehash if its dict is rehashing or under
+// the min fill, call with the slot wrlock held
+static inline void slotMarkDirty(int db, int slot, dict* d) {
+    if (!dictIsRehashing(d) && !htNeedsResize(d)) {
+        return;
+    }
+    uint64_t bit = 1ULL << (slot & 63);
+    if (!(slotsFetchOrU64(&db_slot_infos[db].slot_dirty_bitmap[slot >> 6], bit)
+          & bit)) {
+        slotsAddU32(&db_slot_infos[db].slot_dirty_num, 1);
+    }
+}
+
+// Slots_ClearDirty
+// cron clear the slot after its dict is done resize/rehash
+void Slots_ClearDirty(int db, int slot) {
+    uint64_t bit = 1ULL << (slot & 63);
+    if (slotsFetchAndU64(&db_slot_infos[db].slot_dirty_bitmap[slot >> 6],
+                         ~bit)
+        & bit) {
+        slotsAddU32(&db_slot_infos[db].slot_dirty_num, -1);
+    }
+}
+
+void Slots_ResetKeyCounts(int db) {
+    memset(db_slot_infos[db].slot_key_counts, 0,
+           sizeof(uint32_t) * g_slots_meta_info.hash_slots_size);
+    memset(db_slot_infos[db].slot_bitmap, 0,
+           sizeof(uint64_t)
+               * SLOTS_BITMAP_WORDS(g_slots_meta_info.hash_slots_size));
+    // emptied dicts don't need resize/rehash
+    memset(db_slot_infos[db].slot_dirty_bitmap, 0,
+           sizeof(uint64_t)
+               * SLOTS_BITMAP_WORDS(g_slots_meta_info.hash_slots_size));
+    db_slot_infos[db].slot_dirty_num = 0;
+}
+
+// Slots_Add
+// index key to its slot, return the slot
+int Slots_Add(RedisModuleCtx* ctx, int db, RedisModuleString* key) {
+    SLOTS_LATENCY_BEGIN(start);
     const char* kstr = RedisModule_StringPtrLen(key, NULL);
     uint32_t crc;
     int hastag;
@@ -1288,45 +2394,62 @@ void Slots_Add(RedisModuleCtx* ctx, int db, RedisModuleString* key) {
         = RedisModule_CreateStringFromLongLong(ctx, (long long)crc);
 
     // entry key,val add
-    pthread_rwlock_wrlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    SLOTKEY_TABLE_WRLOCK(db, slot);
     int r = m_dictAdd(db_slot_infos[db].slotkey_tables[slot],
                       takeAndRef(NULL, key), (void*)sval);
-    pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    if (r == DICT_OK) {
+        slotKeyCountIncr(db, slot);
+        slotMarkDirty(db, slot, db_slot_infos[db].slotkey_tables[slot]);
+    }
+    SLOTKEY_TABLE_UNLOCK(db, slot);
     if (r != DICT_OK) {
-        return;
+        SLOTS_LATENCY_END(SLOTS_LATENCY_OP_ADD, start);
+        return slot;
     }
 
     if (hastag) {
         // node key add with score(crc32)
-        pthread_rwlock_wrlock(&(db_slot_infos[db].tagged_key_list_rwlock));
+        TAGGED_KEY_LIST_WRLOCK(db);
         m_zslInsert(db_slot_infos[db].tagged_key_list, (long long)crc,
                     takeAndRef(NULL, key));
-        pthread_rwlock_unlock(&(db_slot_infos[db].tagged_key_list_rwlock));
+        TAGGED_KEY_LIST_UNLOCK(db);
     }
+    SLOTS_LATENCY_END(SLOTS_LATENCY_OP_ADD, start);
+    return slot;
 }
 
-void Slots_Del(RedisModuleCtx* ctx, int db, RedisModuleString* key) {
+// Slots_Del
+// unindex key from its slot, return the slot
+int Slots_Del(RedisModuleCtx* ctx, int db, RedisModuleString* key) {
     UNUSED(ctx);
+    SLOTS_LATENCY_BEGIN(start);
     const char* kstr = RedisModule_StringPtrLen(key, NULL);
     uint32_t crc;
     int hastag;
     int slot = slots_num(kstr, &crc, &hastag);
 
     // entry key,val free
-    pthread_rwlock_wrlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    SLOTKEY_TABLE_WRLOCK(db, slot);
     int r = m_dictDelete(db_slot_infos[db].slotkey_tables[slot], key);
-    pthread_rwlock_unlock(&(db_slot_infos[db].slotkey_table_rwlocks[slot]));
+    if (r == DICT_OK) {
+        slotKeyCountDecr(db, slot);
+        slotMarkDirty(db, slot, db_slot_infos[db].slotkey_tables[slot]);
+    }
+    SLOTKEY_TABLE_UNLOCK(db, slot);
     if (r != DICT_OK) {
-        return;
+        SLOTS_LATENCY_END(SLOTS_LATENCY_OP_DEL, start);
+        return slot;
     }
 
     if (hastag) {
         // node key free with score(crc32)
-        pthread_rwlock_wrlock(&(db_slot_infos[db].tagged_key_list_rwlock));
+        TAGGED_KEY_LIST_WRLOCK(db);
         m_zslDelete(db_slot_infos[db].tagged_key_list, (long long)crc, key,
                     NULL);
-        pthread_rwlock_unlock(&(db_slot_infos[db].tagged_key_list_rwlock));
+        TAGGED_KEY_LIST_UNLOCK(db);
     }
+    SLOTS_LATENCY_END(SLOTS_LATENCY_OP_DEL, start);
+    return slot;
 }
 
 void SlotsMGRT_SetCpuAffinity(const char* cpulist) {
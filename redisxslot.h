@@ -30,6 +30,7 @@
 #define REDISMODULE_EXPERIMENTAL_API
 #ifndef REDISXSLOT_H
 #define REDISXSLOT_H
+#include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
@@ -47,6 +48,7 @@
 
 #include "dep/dict.h"
 #include "dep/list.h"
+#include "dep/lzf.h"
 #include "dep/skiplist.h"
 #include "dep/util.h"
 #include "hiredis/hiredis.h"
@@ -67,12 +69,88 @@
 #define MGRT_BATCH_KEY_TIMEOUT 30               // 30s
 #define REDIS_LONGSTR_SIZE 42                   // Bytes needed for long -> str
 #define REDIS_MGRT_CMD_PARAMS_SIZE 1024 * 1024  // send redis cmd params size
+/* Adaptive mgrt batch (AIMD) bounds, batch keys for dump/send/del, batch bytes
+ * for split send cmd params */
+#define MGRT_BATCH_KEYS_MIN 16
+#define MGRT_BATCH_KEYS_MAX 65536
+#define MGRT_BATCH_KEYS_INIT 256
+#define MGRT_BATCH_KEYS_INCR 32
+#define MGRT_BATCH_BYTES_MIN (64 * 1024)
+#define MGRT_BATCH_BYTES_MAX (16 * 1024 * 1024)
+#define MGRT_BATCH_BYTES_INCR (64 * 1024)
+#define MGRT_BATCH_BUDGET_US_MAX 10000000  // 10s
+#define MGRT_PIPELINE_WINDOW_DEFAULT 4
+#define MGRT_PIPELINE_WINDOW_MAX 1024
+#define MGRT_SHM_RING_BYTES_DEFAULT (64 * 1024 * 1024)
+#define MGRT_SHM_RING_BYTES_MIN (1024 * 1024)
+#define MGRT_SHM_RING_BYTES_MAX (1024 * 1024 * 1024)
+#define SLOTS_YIELD_KEYS_DEFAULT 1000
+#define SLOTS_YIELD_US_DEFAULT 1000
+#define SLOTS_YIELD_MAX 10000000
 #define SLOTS_MGRT_NOTHING 0
 #define SLOTS_MGRT_ERR -1
 #define MAX_NUM_THREADS 128
 #define REDISXSLOT_APIVER_1 1
-/* Hash table cron loop pre call db,slot num for resize rehash(hotkey) */
-#define CRON_DBS_PER_CALL 16
+/* mgrt latency histogram log2(us) buckets, le 1us,2us,4us ... 2^(n-2)us,+inf */
+#define MGRT_LATENCY_HIST_BUCKETS 24
+/* hot path op latency HDR-like histogram, log-linear ns buckets:
+ * 2^SUB_BITS sub buckets per power of 2 (~3% precision), max 2^MAX_BITS ns;
+ * per thread shards (thread -> shard round robin) merge on read */
+#define SLOTS_LATENCY_SUB_BITS 5
+#define SLOTS_LATENCY_MAX_BITS 40
+#define SLOTS_LATENCY_BUCKETS \
+    ((SLOTS_LATENCY_MAX_BITS - SLOTS_LATENCY_SUB_BITS + 1) \
+     << SLOTS_LATENCY_SUB_BITS)
+#define SLOTS_LATENCY_SHARDS 16
+/* per db slot occupancy bitmap words, bit set if the slot has keys */
+#define SLOTS_BITMAP_WORDS(n) (((n) + 63) / 64)
+/* slotsmemory sample keys per slot, sampled MEMORY USAGE calls per cmd,
+ * bgscan keys per GIL hold */
+#define SLOTS_MEMORY_SAMPLES_DEFAULT 16
+#define SLOTS_MEMORY_SAMPLES_MAX 1024
+#define SLOTS_MEMORY_SAMPLE_CALLS_MAX 16384
+#define SLOTS_MEMORY_SCAN_BATCH 128
+/* per db hot keys count-min sketch size, top k keys;
+ * depth * width bits <= 64 (row index is a slice of the key hash) */
+#define SLOTS_HOTKEYS_CMS_WIDTH_BITS 11
+#define SLOTS_HOTKEYS_CMS_WIDTH (1 << SLOTS_HOTKEYS_CMS_WIDTH_BITS)
+#define SLOTS_HOTKEYS_CMS_DEPTH 4
+#define SLOTS_HOTKEYS_TOPK 64
+/* background rehasher buckets per slot wrlock hold, sleep us when idle */
+#define SLOTS_BG_REHASH_STEPS 100
+#define SLOTS_BG_REHASH_IDLE_US 10000
+/* slot index striped rwlocks num (power of 2), stripe = hash(db, slot) */
+#define SLOTS_LOCK_STRIPES_DEFAULT 1024
+#define SLOTS_LOCK_STRIPES_MAX 65536
+#define SLOTS_CACHE_LINE_SIZE 64
+/* slot index epoch reader slots (async block mgrt threads), more readers
+ * share one slow slot */
+#define SLOTS_EPOCH_READERS 64
+/* withcompress mgrt: lzf compress dump vals >= MIN_BYTES, keep if save 1/8;
+ * after POOR_STREAK poor ratio vals, only probe 1 of PROBE vals */
+#define SLOTS_MGRT_COMPRESS_MIN_BYTES 64
+#define SLOTS_MGRT_COMPRESS_POOR_STREAK 32
+#define SLOTS_MGRT_COMPRESS_PROBE 64
+/* mgrtType flags, comma separated, like withbinary,withcompress */
+#define SLOTS_MGRT_PIPELINE (1 << 0)
+#define SLOTS_MGRT_COMPRESS (1 << 1)
+#define SLOTS_MGRT_BINARY (1 << 2)
+#define SLOTS_MGRT_EVENTLOOP (1 << 3)
+#define SLOTS_MGRT_SHM (1 << 4)
+/* mgrt target host prefix of a unix socket path, like unix:/tmp/redis.sock */
+#define SLOTS_MGRT_UNIX_PREFIX "unix:"
+/* withshm mgrt shm ring name prefix, see slotsshm.c */
+#define SLOTS_SHM_PREFIX "/redisxslot-"
+#define SLOTS_SHM_NAME_SIZE 64
+/* slotsrestorebin batch format, see slotsbatch.c */
+#define SLOTS_BATCH_MAGIC "RXSB"
+#define SLOTS_BATCH_VERSION 1
+#define SLOTS_BATCH_HDR_SIZE 12
+#define SLOTS_BATCH_REC_HDR_SIZE 21
+#define SLOTS_BATCH_CRC_SIZE 4
+/* max lzf rawlen of a restored val, redis proto-max-bulk-len default */
+#define SLOTS_RESTORE_RAWLEN_MAX (512 * 1024 * 1024)
+/* Hash table cron loop per call max dirty db slots for resize rehash */
 #define CRON_DB_SLOTS_PER_CALL 1024
 /* Hash table parameters for resize */
 #define HASHTABLE_MIN_FILL 10           /* Minimal hash table fill 10% */
@@ -110,18 +188,58 @@
 #define run_with_period(_ms_, _hz_) \
     if (((_ms_) <= 1000 / _hz_)     \
         || !(g_slots_meta_info.cronloops % ((_ms_) / (1000 / _hz_))))
-#define ASYNC_LOCK(ctx)                             \
-    do {                                            \
-        if (g_slots_meta_info.async) {              \
-            RedisModule_ThreadSafeContextLock(ctx); \
-        }                                           \
+// slots_async_inline: async mode cmd run inline on the main thread (GIL held)
+#define ASYNC_LOCK(ctx)                                        \
+    do {                                                       \
+        if (g_slots_meta_info.async && !slots_async_inline) {  \
+            RedisModule_ThreadSafeContextLock(ctx);            \
+        }                                                      \
     } while (0);
-#define ASYNC_UNLOCK(ctx)                             \
-    do {                                              \
-        if (g_slots_meta_info.async) {                \
-            RedisModule_ThreadSafeContextUnlock(ctx); \
-        }                                             \
+#define ASYNC_UNLOCK(ctx)                                      \
+    do {                                                       \
+        if (g_slots_meta_info.async && !slots_async_inline) {  \
+            RedisModule_ThreadSafeContextUnlock(ctx);          \
+        }                                                      \
     } while (0);
+/* mgrt stats counters are updated from main/async/thread pool threads */
+#define MGRT_STATS_INCR(field, v) \
+    __atomic_add_fetch(&g_slots_mgrt_stats.field, (v), __ATOMIC_RELAXED)
+#define MGRT_STATS_DECR(field, v) \
+    __atomic_sub_fetch(&g_slots_mgrt_stats.field, (v), __ATOMIC_RELAXED)
+#define MGRT_STATS_GET(field) \
+    __atomic_load_n(&g_slots_mgrt_stats.field, __ATOMIC_RELAXED)
+/* hot path op latency tracking, begin is 0 when tracking is off */
+#define SLOTS_LATENCY_BEGIN(var) \
+    uint64_t var                 \
+        = g_slots_meta_info.latency_tracking ? SlotsLatency_NowNs() : 0
+#define SLOTS_LATENCY_END(op, var)                                 \
+    do {                                                           \
+        if (var) {                                                 \
+            SlotsLatency_Add((op), SlotsLatency_NowNs() - (var)); \
+        }                                                          \
+    } while (0)
+
+/* slot index locks, elided (slot_locking 0) when only the main thread or
+ * threads holding the GIL touch the index: no thread pool, no async block
+ * and no bg rehash thread */
+#define SLOTS_RWLOCK(op, lock)                 \
+    do {                                       \
+        if (g_slots_meta_info.slot_locking) {  \
+            pthread_rwlock_##op(lock);         \
+        }                                      \
+    } while (0)
+#define SLOTKEY_TABLE_RDLOCK(db, slot) \
+    SLOTS_RWLOCK(rdlock, slotKeyTableLock(db, slot))
+#define SLOTKEY_TABLE_WRLOCK(db, slot) \
+    SLOTS_RWLOCK(wrlock, slotKeyTableLock(db, slot))
+#define SLOTKEY_TABLE_UNLOCK(db, slot) \
+    SLOTS_RWLOCK(unlock, slotKeyTableLock(db, slot))
+#define TAGGED_KEY_LIST_RDLOCK(db) \
+    SLOTS_RWLOCK(rdlock, &(db_slot_infos[db].tagged_key_list_rwlock))
+#define TAGGED_KEY_LIST_WRLOCK(db) \
+    SLOTS_RWLOCK(wrlock, &(db_slot_infos[db].tagged_key_list_rwlock))
+#define TAGGED_KEY_LIST_UNLOCK(db) \
+    SLOTS_RWLOCK(unlock, &(db_slot_infos[db].tagged_key_list_rwlock))
 
 // define struct type
 typedef struct _slots_meta_info {
@@ -140,8 +258,117 @@ typedef struct _slots_meta_info {
     int slots_dump_threads;
     int slots_mgrt_threads;
     int slots_restore_threads;
+    // adaptive mgrt batch per batch main thread budget(us), 0 don't adapt
+    int mgrt_batch_budget_us;
+    // hot path op latency tracking yes(1)/no(0), see slotsstats
+    int latency_tracking;
+    // per slot heat counters halve every halflife seconds, see slotsheat
+    int heat_halflife_sec;
+    // count read cmd keys per slot with command filter yes(1)/no(0)
+    int heat_read_tracking;
+    // per db hot keys sketch of key writes yes(1)/no(0), see slotshotkeys
+    int hotkeys_tracking;
+    // rehash slot dicts on a background thread instead of cron yes(1)/no(0)
+    int bg_rehash;
+    // setcpuaffinity for background rehash thread
+    const char* bg_rehash_cpulist;
+    // slot index locks and atomics on, set by Slots_Init, see SLOTS_RWLOCK
+    int slot_locking;
+    // slot index striped rwlocks num, round up to power of 2
+    int lock_stripes;
+    // sync mgrt/slotsdel/restore yield to event loop every N keys or T us,
+    // 0 don't check, see RedisModule_Yield
+    int yield_keys;
+    int yield_us;
+    // mgrt split chunks sent to a conn without waiting the acks
+    int mgrt_pipeline_window;
+    // withshm mgrt shm ring bytes per mgrt conn
+    int mgrt_shm_ring_bytes;
 } slots_meta_info;
 
+typedef struct _mgrt_batch_ctrl {
+    pthread_mutex_t lock;
+    // keys per dump/send/del batch
+    int batch_keys;
+    // split threshold of the send cmd params
+    size_t batch_bytes;
+} mgrt_batch_ctrl;
+
+typedef struct _slots_latency_hist {
+    uint64_t buckets[MGRT_LATENCY_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+} slots_latency_hist;
+
+typedef enum _slots_latency_op {
+    SLOTS_LATENCY_OP_ADD = 0,
+    SLOTS_LATENCY_OP_DEL,
+    SLOTS_LATENCY_OP_DUMP,
+    SLOTS_LATENCY_OP_RESTORE,
+    SLOTS_LATENCY_OP_CRON,
+    SLOTS_LATENCY_OP_NUM,
+} slots_latency_op;
+
+typedef struct _slots_latency_summary {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} slots_latency_summary;
+
+typedef struct _slot_heat {
+    // decay epoch of the counters
+    uint32_t epoch;
+    uint32_t writes;
+    uint32_t reads;
+} slot_heat;
+
+typedef enum _slots_heat_by {
+    SLOTS_HEAT_BY_ALL = 0,
+    SLOTS_HEAT_BY_WRITES,
+    SLOTS_HEAT_BY_READS,
+} slots_heat_by;
+
+typedef struct _slots_hotkey {
+    RedisModuleString* key;
+    int slot;
+    // estimated decayed writes
+    uint32_t count;
+} slots_hotkey;
+
+typedef struct _slots_mgrt_stats {
+    // source side
+    uint64_t keys_migrated;
+    uint64_t bytes_migrated;
+    uint64_t keys_deleted;
+    uint64_t batches;
+    uint64_t inflight_batches;
+    // withcompress dump vals bytes before/after lzf
+    uint64_t compress_raw_bytes;
+    uint64_t compress_bytes;
+    // withshm batches bytes written to shm rings
+    uint64_t shm_bytes;
+    // target side
+    uint64_t keys_restored;
+    uint64_t bytes_restored;
+    // connects
+    uint64_t conns_created;
+    uint64_t conns_closed;
+    uint64_t conns_timedout;
+    // errors
+    uint64_t dump_errors;
+    uint64_t send_errors;
+    uint64_t del_errors;
+    uint64_t restore_errors;
+    uint64_t conn_errors;
+    // per batch cost
+    slots_latency_hist dump_latency;
+    slots_latency_hist send_latency;
+    slots_latency_hist del_latency;
+} slots_mgrt_stats;
+
 typedef struct _db_slot_info {
     // current db
     int db;
@@ -149,8 +376,15 @@ typedef struct _db_slot_info {
     int slotkey_table_rehashing;
     // hash table entry: RedisModuleString* key,val(crc)
     dict** slotkey_tables;
-    // slotkey_table db slot dict's rwlocks
-    pthread_rwlock_t* slotkey_table_rwlocks;
+    // per slot keys count (dictSize), update with slot dict under slot wrlock
+    uint32_t* slot_key_counts;
+    // slot occupancy bitmap, slotsinfo only walk the non empty slots
+    uint64_t* slot_bitmap;
+    // cron dirty slot bitmap, bit set if the slot dict is rehashing or
+    // under HASHTABLE_MIN_FILL, cron only resize/rehash the dirty slots
+    uint64_t* slot_dirty_bitmap;
+    // dirty bits num, cron skip the db if 0
+    uint32_t slot_dirty_num;
     // member: RedisModuleString* key, score: uint32_t crc
     m_zskiplist* tagged_key_list;
     // tagged_key_list per db's rwlock
@@ -164,12 +398,36 @@ typedef struct _slot_mgrt_connet_meta {
     sds host;
     sds port;
     struct timeval timeout;
+    // SLOTS_MGRT_* flags parsed from mgrtType
+    int flags;
 } slot_mgrt_connet_meta;
+// withshm mgrt ring, a shm segment mapped by the source (rw) and the target
+// (ro, per slotsrestoreshm), batches are written at wpos % size and freed
+// to rpos when acked (FIFO like the pipe chunks); wpos/rpos only increase.
+typedef struct _slots_shm_ring {
+    char name[SLOTS_SHM_NAME_SIZE];
+    char* base;
+    size_t size;
+    uint64_t wpos;
+    uint64_t rpos;
+} slots_shm_ring;
+// ack-only reply reader state of a mgrt conn, replies aren't allocated,
+// only count the errors and keep the first error msg
+#define SLOTS_MGRT_ACK_ERRMSG_SIZE 128
+typedef struct _slots_mgrt_ack {
+    int errors;
+    char errmsg[SLOTS_MGRT_ACK_ERRMSG_SIZE];
+} slots_mgrt_ack;
 typedef struct _db_slot_mgrt_connet {
     // pointer only one meta info per conn
     slot_mgrt_connet_meta* meta;
     time_t last_time;
     redisContext* conn_ctx;
+    slots_mgrt_ack ack;
+    // withshm batches ring, NULL if not withshm
+    slots_shm_ring* shm;
+    // next idle conn of the target in the pool
+    struct _db_slot_mgrt_connet* next;
 } db_slot_mgrt_connect;
 
 // declare struct and define diff type
@@ -177,21 +435,60 @@ struct _rdb_obj {
     RedisModuleString* key;
     RedisModuleString* val;
     time_t ttlms;
+    // >0: val is lzf compressed, rawlen is the dump val len
+    size_t rawlen;
 };
 typedef struct _rdb_obj rdb_dump_obj;
 typedef struct _rdb_obj rdb_parse_obj;
 
+// chunk in flight on a mgrt conn, wait replies acks of objs [start, end)
+typedef struct _slots_mgrt_pipe_chunk {
+    int start_pos;
+    int end_pos;
+    int replies;
+    // conn shm ring wpos after the chunk, freed to it when acked
+    uint64_t shm_end;
+} slots_mgrt_pipe_chunk;
+
+typedef struct _slots_mgrt_pipe {
+    db_slot_mgrt_connect* conn;
+    // max chunks in flight, ring of chunks
+    int window;
+    int head;
+    int len;
+    slots_mgrt_pipe_chunk* chunks;
+} slots_mgrt_pipe;
+
+// slotsrestorebin record, points into the batch buf
+typedef struct _slots_batch_record {
+    const char* key;
+    size_t klen;
+    const char* val;
+    size_t vlen;
+    // >0: val is lzf compressed, rawlen is the dump val len
+    size_t rawlen;
+    time_t ttlms;
+    uint8_t type;
+} slots_batch_record;
+
 typedef struct _slots_restore_one_task_params {
+    // restore obj, or rec if obj is NULL
     rdb_dump_obj* obj;
+    slots_batch_record* rec;
     int result_code;
 } slots_restore_one_task_params;
 
 typedef struct _slots_split_restore_params {
     slot_mgrt_connet_meta* meta;
+    // withbinary encode objs [start_pos, end_pos) instead of argv
+    rdb_dump_obj** objs;
     char** argv;
     size_t* argvlen;
-    int start_pos;
-    int end_pos;
+    // send split chunks [chunk_start, chunk_end), chunk i is objs
+    // [bounds[i], bounds[i + 1])
+    int* bounds;
+    int chunk_start;
+    int chunk_end;
     int result_code;
 } slots_split_restore_params;
 
@@ -208,9 +505,35 @@ typedef struct _bg_call_params {
     int argc;
 } bg_call_params;
 
+// slotkey_table db slot dict's rwlock stripe, one cache line each,
+// diff stripes don't false share
+typedef struct _slots_rwlock_stripe {
+    pthread_rwlock_t lock;
+} __attribute__((aligned(SLOTS_CACHE_LINE_SIZE))) slots_rwlock_stripe;
+
+// long sync cmd yield state, ctx NULL if can't yield
+typedef struct _slots_yield {
+    RedisModuleCtx* ctx;
+    int keys;
+    uint64_t last_ns;
+} slots_yield;
+
 // declare defined extern var to out use
 extern slots_meta_info g_slots_meta_info;
 extern db_slot_info* db_slot_infos;
+extern slots_rwlock_stripe* slots_lock_stripes;
+extern slots_mgrt_stats g_slots_mgrt_stats;
+extern __thread int slots_async_inline;
+extern int slots_yielding;
+extern m_dictType hashSlotDictType;
+
+// slotKeyTableLock
+// the stripe of (db, slot), adjacent slots of a db use adjacent stripes,
+// dbs are spread with a golden ratio multiplier
+static inline pthread_rwlock_t* slotKeyTableLock(int db, int slot) {
+    uint32_t h = (uint32_t)db * 0x9E3779B1u + (uint32_t)slot;
+    return &slots_lock_stripes[h & (g_slots_meta_info.lock_stripes - 1)].lock;
+}
 
 // declare api function
 void crc32_init();
@@ -233,13 +556,91 @@ int SlotsMGRT_TagKeys(RedisModuleCtx* ctx, const char* host, const char* port,
 int SlotsMGRT_TagSlotKeys(RedisModuleCtx* ctx, const char* host,
                           const char* port, time_t timeout, int slot,
                           const char* mgrtType, int* left);
+int SlotsMGRT_GetMgrtKeys(RedisModuleCtx* ctx, int slot,
+                          RedisModuleString* key, int withtag,
+                          RedisModuleString*** keys);
+int SlotsMGRT_ParseFlags(const char* mgrtType);
+const char* SlotsMGRT_UnixPath(const char* host);
+sds SlotsMGRT_TargetName(const char* host, const char* port);
+int SlotsMGRT_DumpKeys(RedisModuleCtx* ctx, RedisModuleString* keys[], int n,
+                       rdb_dump_obj** objs);
+int SlotsMGRT_DelKeys(RedisModuleCtx* ctx, RedisModuleString* keys[], int n);
 int SlotsMGRT_Restore(RedisModuleCtx* ctx, rdb_dump_obj* objs[], int n);
+int SlotsMGRT_RestoreBatch(RedisModuleCtx* ctx, const char* buf, size_t len);
+size_t SlotsMGRT_CompressVal(const char* v, size_t vsz, char* out);
 unsigned long SlotsMGRT_Scan(RedisModuleCtx* ctx, int slot, unsigned long count,
                              unsigned long cursor, list* l);
 int SlotsMGRT_DelSlotKeys(RedisModuleCtx* ctx, int db, int slots[], int n);
 void SlotsMGRT_CloseTimedoutConns(RedisModuleCtx* ctx);
-void Slots_Add(RedisModuleCtx* ctx, int db, RedisModuleString* key);
-void Slots_Del(RedisModuleCtx* ctx, int db, RedisModuleString* key);
+void SlotsMGRT_GetBatchSize(int* batch_keys, size_t* batch_bytes);
+uint64_t SlotsMGRT_CachedConnsNum(void);
+int SlotsMGRT_Connect(RedisModuleCtx* ctx, const char* host, const char* port,
+                      time_t timeoutMS, int count);
+void SlotsYield_Init(RedisModuleCtx* ctx, slots_yield* y);
+void SlotsYield_Keys(slots_yield* y, int keys);
+void SlotsMGRT_LatencyHistAdd(slots_latency_hist* hist, double us);
+uint64_t SlotsLatency_NowNs(void);
+void SlotsLatency_Add(slots_latency_op op, uint64_t ns);
+void SlotsLatency_Summary(slots_latency_op op, slots_latency_summary* s);
+void SlotsLatency_Reset(void);
+const char* SlotsLatency_OpName(slots_latency_op op);
+long long SlotsMemory_Sample(RedisModuleCtx* ctx, int db, int slot,
+                             int samples);
+int SlotsMemory_BGScan(RedisModuleCtx* ctx, int db);
+const uint64_t* SlotsMemory_FullResult(int db);
+void SlotsMemory_Free(RedisModuleCtx* ctx);
+void Slots_ResetKeyCounts(int db);
+void Slots_ClearDirty(int db, int slot);
+void SlotsEpoch_Enter(void);
+void SlotsEpoch_Exit(void);
+int SlotsEpoch_Held(void);
+void SlotsEpoch_RetireKey(RedisModuleString* key);
+void SlotsEpoch_Cron(void);
+uint64_t SlotsEpoch_RetiredKeys(void);
+int SlotsEpoch_SlowReaders(uint64_t* enters);
+void SlotsEpoch_Free(void);
+
+size_t SlotsBatch_EncodeBound(rdb_dump_obj* objs[], int start, int end);
+size_t SlotsBatch_Encode(rdb_dump_obj* objs[], int start, int end,
+                         int compress, char* buf);
+int SlotsBatch_Check(const char* buf, size_t len);
+int SlotsBatch_RawlenValid(size_t vlen, size_t rawlen);
+size_t SlotsBatch_Read(const char* buf, size_t pos, slots_batch_record* rec);
+slots_shm_ring* SlotsShm_RingCreate(size_t size);
+void SlotsShm_RingFree(slots_shm_ring* ring);
+char* SlotsShm_RingReserve(slots_shm_ring* ring, size_t len, size_t* off);
+void SlotsShm_RingCommit(slots_shm_ring* ring, size_t len);
+void SlotsShm_RingRelease(slots_shm_ring* ring, uint64_t pos);
+const char* SlotsShm_Map(const char* name, long long off, long long len,
+                         void** map, size_t* maplen);
+void SlotsShm_Unmap(void* map, size_t maplen);
+int SlotsMGRTLoop_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                               int argc);
+void SlotsMGRTLoop_CloseTimedoutConns(RedisModuleCtx* ctx);
+uint64_t SlotsMGRTLoop_ConnsNum(void);
+void SlotsMGRTLoop_Free(void);
+int SlotsRehash_Start(void);
+void SlotsRehash_Stop(void);
+int SlotsRehash_Running(void);
+void SlotsRehash_SetPaused(int paused);
+int htNeedsResize(dict* dict);
+void SlotsHeat_Init(RedisModuleCtx* ctx);
+void SlotsHeat_Free(RedisModuleCtx* ctx);
+void SlotsHeat_Cron(void);
+uint32_t SlotsHeat_Epoch(void);
+void SlotsHeat_Reset(void);
+void SlotsHeat_Write(int slot);
+void SlotsHeat_CommandFilter(RedisModuleCommandFilterCtx* fctx);
+int SlotsHeat_TopK(int k, int by, int* slots, slot_heat* heats);
+void SlotsHotKeys_Init(void);
+void SlotsHotKeys_Free(void);
+void SlotsHotKeys_Reset(int db);
+void SlotsHotKeys_Cron(void);
+void SlotsHotKeys_Touch(int db, int slot, RedisModuleString* key);
+void SlotsHotKeys_Del(int db, RedisModuleString* key);
+int SlotsHotKeys_Get(int db, int slot, slots_hotkey* out);
+int Slots_Add(RedisModuleCtx* ctx, int db, RedisModuleString* key);
+int Slots_Del(RedisModuleCtx* ctx, int db, RedisModuleString* key);
 void FreeDumpObjs(RedisModuleCtx* ctx, rdb_dump_obj** objs, int n);
 /* Check if we can use setcpuaffinity(). */
 #if (defined __linux || defined __NetBSD__ || defined __FreeBSD__ \
@@ -249,4 +650,4 @@ void setcpuaffinity(const char* cpulist);
 #endif
 void SlotsMGRT_SetCpuAffinity(const char* cpulist);
 
-#endif /* REDISXSLOT_H */
\ No newline at end of file
+#endif /* REDISXSLOT_H */
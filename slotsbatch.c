@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+// slotsrestorebin batch, one bulk arg carry a split of migrate keys,
+// little endian, decoded in place (records point into the batch buf):
+//   header:  "RXSB" | u8 version | u8 reserved[3] | u32 count
+//   record:  u32 klen | u32 vlen | u32 rawlen | i64 ttlms | u8 type
+//            | key | val
+//   trailer: u32 crc32 of header and records
+// rawlen > 0: val is the lzf compressed dump payload of rawlen bytes.
+// type: rdb object type, the first byte of the dump payload.
+
+static inline void putU32(char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (char)(v >> (i * 8));
+    }
+}
+
+static inline uint32_t getU32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        v |= (uint32_t)(uint8_t)p[i] << (i * 8);
+    }
+    return v;
+}
+
+static inline void putU64(char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (char)(v >> (i * 8));
+    }
+}
+
+static inline uint64_t getU64(const char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t)(uint8_t)p[i] << (i * 8);
+    }
+    return v;
+}
+
+// SlotsBatch_EncodeBound
+// max batch bytes of objs [start, end), compressed vals are never bigger
+size_t SlotsBatch_EncodeBound(rdb_dump_obj* objs[], int start, int end) {
+    size_t size = SLOTS_BATCH_HDR_SIZE + SLOTS_BATCH_CRC_SIZE;
+    for (int i = start; i < end; i++) {
+        size_t ksz, vsz;
+        RedisModule_StringPtrLen(objs[i]->key, &ksz);
+        RedisModule_StringPtrLen(objs[i]->val, &vsz);
+        size += SLOTS_BATCH_REC_HDR_SIZE + ksz + vsz;
+    }
+    return size;
+}
+
+// SlotsBatch_Encode
+// encode objs [start, end) to buf (SlotsBatch_EncodeBound bytes),
+// compress: lzf compress vals (SlotsMGRT_CompressVal), return batch len
+size_t SlotsBatch_Encode(rdb_dump_obj* objs[], int start, int end,
+                         int compress, char* buf) {
+    char* p = buf;
+    memcpy(p, SLOTS_BATCH_MAGIC, 4);
+    p[4] = SLOTS_BATCH_VERSION;
+    p[5] = p[6] = p[7] = 0;
+    putU32(p + 8, (uint32_t)(end - start));
+    p += SLOTS_BATCH_HDR_SIZE;
+
+    size_t raw_bytes = 0, bytes = 0;
+    for (int i = start; i < end; i++) {
+        size_t ksz, vsz;
+        const char* k = RedisModule_StringPtrLen(objs[i]->key, &ksz);
+        const char* v = RedisModule_StringPtrLen(objs[i]->val, &vsz);
+        char* rec = p;
+        char* val = rec + SLOTS_BATCH_REC_HDR_SIZE + ksz;
+        size_t clen = compress ? SlotsMGRT_CompressVal(v, vsz, val) : 0;
+        if (clen == 0) {
+            memcpy(val, v, vsz);
+        }
+        putU32(rec, (uint32_t)ksz);
+        putU32(rec + 4, (uint32_t)(clen > 0 ? clen : vsz));
+        putU32(rec + 8, (uint32_t)(clen > 0 ? vsz : 0));
+        putU64(rec + 12, (uint64_t)(objs[i]->ttlms > 0 ? objs[i]->ttlms : 0));
+        rec[20] = vsz > 0 ? v[0] : 0;
+        memcpy(rec + SLOTS_BATCH_REC_HDR_SIZE, k, ksz);
+        p = val + (clen > 0 ? clen : vsz);
+        raw_bytes += vsz;
+        bytes += clen > 0 ? clen : vsz;
+    }
+    if (compress) {
+        MGRT_STATS_INCR(compress_raw_bytes, raw_bytes);
+        MGRT_STATS_INCR(compress_bytes, bytes);
+    }
+
+    putU32(p, crc32_checksum(buf, (int)(p - buf)));
+    p += SLOTS_BATCH_CRC_SIZE;
+    return (size_t)(p - buf);
+}
+
+// SlotsBatch_RawlenValid
+// rawlen of a lzf compressed val (from the client) is allocated to
+// decompress, reject it if vlen can't expand to it or it's too big
+int SlotsBatch_RawlenValid(size_t vlen, size_t rawlen) {
+    return rawlen <= SLOTS_RESTORE_RAWLEN_MAX
+           && rawlen <= vlen * M_LZF_MAX_EXPAND;
+}
+
+// SlotsBatch_Check
+// check magic, version, crc and record bounds (SlotsBatch_Read is safe then)
+// return record count, -1 if the batch is invalid
+int SlotsBatch_Check(const char* buf, size_t len) {
+    if (len < SLOTS_BATCH_HDR_SIZE + SLOTS_BATCH_CRC_SIZE || len > INT_MAX
+        || memcmp(buf, SLOTS_BATCH_MAGIC, 4) != 0
+        || buf[4] != SLOTS_BATCH_VERSION) {
+        return -1;
+    }
+    size_t body = len - SLOTS_BATCH_CRC_SIZE;
+    if (crc32_checksum(buf, (int)body) != getU32(buf + body)) {
+        return -1;
+    }
+    uint32_t count = getU32(buf + 8);
+    if (count > INT_MAX) {
+        return -1;
+    }
+
+    size_t pos = SLOTS_BATCH_HDR_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        if (body - pos < SLOTS_BATCH_REC_HDR_SIZE) {
+            return -1;
+        }
+        size_t klen = getU32(buf + pos);
+        size_t vlen = getU32(buf + pos + 4);
+        size_t rawlen = getU32(buf + pos + 8);
+        pos += SLOTS_BATCH_REC_HDR_SIZE;
+        if (body - pos < klen || body - pos - klen < vlen) {
+            return -1;
+        }
+        // raw dump payload type must match
+        if (rawlen == 0 && vlen > 0
+            && buf[pos - 1] != buf[pos + klen]) {
+            return -1;
+        }
+        if (!SlotsBatch_RawlenValid(vlen, rawlen)) {
+            return -1;
+        }
+        pos += klen + vlen;
+    }
+    if (pos != body) {
+        return -1;
+    }
+    return (int)count;
+}
+
+// SlotsBatch_Read
+// decode the record at pos of a checked batch (first at SLOTS_BATCH_HDR_SIZE)
+// without copy, return the next record pos
+size_t SlotsBatch_Read(const char* buf, size_t pos, slots_batch_record* rec) {
+    const char* p = buf + pos;
+    rec->klen = getU32(p);
+    rec->vlen = getU32(p + 4);
+    rec->rawlen = getU32(p + 8);
+    rec->ttlms = (time_t)getU64(p + 12);
+    rec->type = (uint8_t)p[20];
+    rec->key = p + SLOTS_BATCH_REC_HDR_SIZE;
+    rec->val = rec->key + rec->klen;
+    return pos + SLOTS_BATCH_REC_HDR_SIZE + rec->klen + rec->vlen;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+// epoch based reclamation of slot index key strings:
+// threads not holding the GIL (async block mgrt) use keys read from the slot
+// index after the slot rdlock is released, so the dict key destructor
+// retires keys with the current epoch instead of freeing them, the cron
+// advances the epoch and frees retired keys older than all active readers.
+// retire and reclaim run on main thread or with GIL.
+typedef struct _slots_epoch_reader {
+    // 0 if not in read section
+    uint64_t epoch;
+} __attribute__((aligned(SLOTS_CACHE_LINE_SIZE))) slots_epoch_reader;
+
+typedef struct _slots_retired_key {
+    RedisModuleString* key;
+    uint64_t epoch;
+} slots_retired_key;
+
+static slots_epoch_reader epoch_readers[SLOTS_EPOCH_READERS];
+// shared slow reader slot if all reader slots are busy (async block threads
+// are one per cmd), epoch of the first reader in it, conservative for the
+// later ones
+static struct {
+    pthread_mutex_t lock;
+    int readers;
+    uint64_t epoch;
+    uint64_t enters;
+} epoch_slow = {PTHREAD_MUTEX_INITIALIZER, 0, 0, 0};
+// reader slot held by the thread, -1 if not in read section,
+// SLOTS_EPOCH_READERS for the slow slot
+static __thread int epoch_tls_reader = -1;
+static uint64_t global_epoch = 1;
+// retired keys in epoch order, [head, len) not freed
+static slots_retired_key* retired_keys = NULL;
+static size_t retired_head = 0;
+static size_t retired_len = 0;
+static size_t retired_cap = 0;
+
+// SlotsEpoch_Enter
+// enter read section on the calling thread, don't spin if all reader slots
+// are busy, share the slow slot
+void SlotsEpoch_Enter(void) {
+    for (int i = 0; i < SLOTS_EPOCH_READERS; i++) {
+        uint64_t expect = 0;
+        uint64_t e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+        if (__atomic_compare_exchange_n(&epoch_readers[i].epoch, &expect, e,
+                                        0, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED)) {
+            epoch_tls_reader = i;
+            return;
+        }
+    }
+    pthread_mutex_lock(&epoch_slow.lock);
+    if (epoch_slow.readers++ == 0) {
+        epoch_slow.epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    }
+    epoch_slow.enters++;
+    pthread_mutex_unlock(&epoch_slow.lock);
+    epoch_tls_reader = SLOTS_EPOCH_READERS;
+}
+
+void SlotsEpoch_Exit(void) {
+    int reader = epoch_tls_reader;
+    if (reader < 0) {
+        return;
+    }
+    epoch_tls_reader = -1;
+    if (reader < SLOTS_EPOCH_READERS) {
+        __atomic_store_n(&epoch_readers[reader].epoch, 0, __ATOMIC_SEQ_CST);
+        return;
+    }
+    pthread_mutex_lock(&epoch_slow.lock);
+    if (--epoch_slow.readers == 0) {
+        epoch_slow.epoch = 0;
+    }
+    pthread_mutex_unlock(&epoch_slow.lock);
+}
+
+// SlotsEpoch_Held
+// return 1 if the calling thread is in read section
+int SlotsEpoch_Held(void) {
+    return epoch_tls_reader >= 0;
+}
+
+void SlotsEpoch_RetireKey(RedisModuleString* key) {
+    if (retired_len == retired_cap) {
+        retired_cap = retired_cap ? retired_cap * 2 : 1024;
+        retired_keys = RedisModule_Realloc(
+            retired_keys, sizeof(slots_retired_key) * retired_cap);
+    }
+    retired_keys[retired_len].key = key;
+    retired_keys[retired_len].epoch
+        = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    retired_len++;
+}
+
+static void epochFreeRetired(uint64_t before) {
+    while (retired_head < retired_len
+           && retired_keys[retired_head].epoch < before) {
+        RedisModule_FreeString(NULL, retired_keys[retired_head].key);
+        retired_head++;
+    }
+    if (retired_head == retired_len) {
+        retired_head = retired_len = 0;
+    } else if (retired_head > retired_cap / 2) {
+        memmove(retired_keys, retired_keys + retired_head,
+                sizeof(slots_retired_key) * (retired_len - retired_head));
+        retired_len -= retired_head;
+        retired_head = 0;
+    }
+}
+
+// SlotsEpoch_Cron
+// advance the epoch, free the keys retired before the oldest active reader
+void SlotsEpoch_Cron(void) {
+    uint64_t min = __atomic_add_fetch(&global_epoch, 1, __ATOMIC_SEQ_CST);
+    if (retired_head == retired_len) {
+        return;
+    }
+    for (int i = 0; i < SLOTS_EPOCH_READERS; i++) {
+        uint64_t e = __atomic_load_n(&epoch_readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && e < min) {
+            min = e;
+        }
+    }
+    pthread_mutex_lock(&epoch_slow.lock);
+    if (epoch_slow.readers > 0 && epoch_slow.epoch < min) {
+        min = epoch_slow.epoch;
+    }
+    pthread_mutex_unlock(&epoch_slow.lock);
+    epochFreeRetired(min);
+}
+
+// retired keys not freed yet (list len)
+uint64_t SlotsEpoch_RetiredKeys(void) {
+    return retired_len - retired_head;
+}
+
+// readers in the slow slot now, *enters: cumulative slow slot enters
+int SlotsEpoch_SlowReaders(uint64_t* enters) {
+    pthread_mutex_lock(&epoch_slow.lock);
+    int readers = epoch_slow.readers;
+    *enters = epoch_slow.enters;
+    pthread_mutex_unlock(&epoch_slow.lock);
+    return readers;
+}
+
+// SlotsEpoch_Free
+// free all retired keys, call after readers stop
+void SlotsEpoch_Free(void) {
+    epochFreeRetired(UINT64_MAX);
+    RedisModule_Free(retired_keys);
+    retired_keys = NULL;
+    retired_head = retired_len = retired_cap = 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+// per slot heat (all dbs, command filter don't know the client db),
+// update and read on main thread or with GIL, no lock.
+static slot_heat* slots_heat = NULL;
+// current decay epoch, cron update it, counters halve per epoch lazily
+static uint32_t slots_heat_epoch = 0;
+// read cmd name -> slots_heat_read_cmd
+static RedisModuleDict* slots_heat_read_cmds = NULL;
+
+typedef struct _slots_heat_read_cmd {
+    const char* name;
+    // all args are keys (mget, exists ...), otherwise only argv[1]
+    int allkeys;
+} slots_heat_read_cmd;
+
+static slots_heat_read_cmd heat_read_cmds[] = {
+    {"get", 0},           {"mget", 1},          {"strlen", 0},
+    {"getrange", 0},      {"getbit", 0},        {"bitcount", 0},
+    {"bitpos", 0},        {"exists", 1},        {"type", 0},
+    {"ttl", 0},           {"pttl", 0},          {"dump", 0},
+    {"hget", 0},          {"hmget", 0},         {"hgetall", 0},
+    {"hexists", 0},       {"hlen", 0},          {"hkeys", 0},
+    {"hvals", 0},         {"hstrlen", 0},       {"hscan", 0},
+    {"hrandfield", 0},    {"lrange", 0},        {"llen", 0},
+    {"lindex", 0},        {"lpos", 0},          {"scard", 0},
+    {"smembers", 0},      {"sismember", 0},     {"smismember", 0},
+    {"srandmember", 0},   {"sscan", 0},         {"zcard", 0},
+    {"zscore", 0},        {"zmscore", 0},       {"zrange", 0},
+    {"zrangebyscore", 0}, {"zrevrange", 0},     {"zrevrangebyscore", 0},
+    {"zrangebylex", 0},   {"zrank", 0},         {"zrevrank", 0},
+    {"zcount", 0},        {"zlexcount", 0},     {"zscan", 0},
+    {"pfcount", 1},       {"xrange", 0},        {"xrevrange", 0},
+    {"xlen", 0},          {NULL, 0},
+};
+
+static uint32_t slotsHeatEpochNow(void) {
+    long long halflife_ms
+        = (long long)g_slots_meta_info.heat_halflife_sec * 1000;
+    return (uint32_t)(RedisModule_Milliseconds() / halflife_ms);
+}
+
+// slotHeatDecay
+// halve counters once per passed epoch, epoch back (halflife changed) no decay
+static inline void slotHeatDecay(slot_heat* h) {
+    int32_t d = (int32_t)(slots_heat_epoch - h->epoch);
+    if (d > 0) {
+        if (d >= 32) {
+            h->writes = 0;
+            h->reads = 0;
+        } else {
+            h->writes >>= d;
+            h->reads >>= d;
+        }
+    }
+    h->epoch = slots_heat_epoch;
+}
+
+void SlotsHeat_Init(RedisModuleCtx* ctx) {
+    slots_heat = RedisModule_Calloc(g_slots_meta_info.hash_slots_size,
+                                    sizeof(slot_heat));
+    slots_heat_epoch = slotsHeatEpochNow();
+    for (uint32_t i = 0; i < g_slots_meta_info.hash_slots_size; i++) {
+        slots_heat[i].epoch = slots_heat_epoch;
+    }
+    slots_heat_read_cmds = RedisModule_CreateDict(ctx);
+    for (slots_heat_read_cmd* c = heat_read_cmds; c->name != NULL; c++) {
+        RedisModule_DictSetC(slots_heat_read_cmds, (void*)c->name,
+                             strlen(c->name), c);
+    }
+}
+
+void SlotsHeat_Free(RedisModuleCtx* ctx) {
+    if (slots_heat_read_cmds != NULL) {
+        RedisModule_FreeDict(ctx, slots_heat_read_cmds);
+        slots_heat_read_cmds = NULL;
+    }
+    RedisModule_Free(slots_heat);
+    slots_heat = NULL;
+}
+
+void SlotsHeat_Cron(void) {
+    slots_heat_epoch = slotsHeatEpochNow();
+}
+
+uint32_t SlotsHeat_Epoch(void) {
+    return slots_heat_epoch;
+}
+
+void SlotsHeat_Reset(void) {
+    for (uint32_t i = 0; i < g_slots_meta_info.hash_slots_size; i++) {
+        slots_heat[i].epoch = slots_heat_epoch;
+        slots_heat[i].writes = 0;
+        slots_heat[i].reads = 0;
+    }
+}
+
+void SlotsHeat_Write(int slot) {
+    if (slots_heat == NULL) {
+        return;
+    }
+    slot_heat* h = &slots_heat[slot];
+    slotHeatDecay(h);
+    if (h->writes != UINT32_MAX) {
+        h->writes++;
+    }
+}
+
+static inline void slotsHeatRead(RedisModuleString* key) {
+    slot_heat* h
+        = &slots_heat[slots_num(RedisModule_StringPtrLen(key, NULL), NULL,
+                                NULL)];
+    slotHeatDecay(h);
+    if (h->reads != UINT32_MAX) {
+        h->reads++;
+    }
+}
+
+// SlotsHeat_CommandFilter
+// count white list read cmd keys per slot when heat_read_tracking yes
+void SlotsHeat_CommandFilter(RedisModuleCommandFilterCtx* fctx) {
+    if (!g_slots_meta_info.heat_read_tracking || slots_heat == NULL) {
+        return;
+    }
+    int argc = RedisModule_CommandFilterArgsCount(fctx);
+    if (argc < 2) {
+        return;
+    }
+    size_t len;
+    const char* name
+        = RedisModule_StringPtrLen(RedisModule_CommandFilterArgGet(fctx, 0),
+                                   &len);
+    char lname[32];
+    if (len >= sizeof(lname)) {
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        lname[i] = (char)tolower((unsigned char)name[i]);
+    }
+    slots_heat_read_cmd* c
+        = RedisModule_DictGetC(slots_heat_read_cmds, lname, len, NULL);
+    if (c == NULL) {
+        return;
+    }
+    int last = c->allkeys ? argc - 1 : 1;
+    for (int i = 1; i <= last; i++) {
+        slotsHeatRead(RedisModule_CommandFilterArgGet(fctx, i));
+    }
+}
+
+static inline uint64_t slotHeatScore(const slot_heat* h, int by) {
+    switch (by) {
+        case SLOTS_HEAT_BY_WRITES:
+            return h->writes;
+        case SLOTS_HEAT_BY_READS:
+            return h->reads;
+        default:
+            return (uint64_t)h->writes + h->reads;
+    }
+}
+
+// min heap of slot by score, heap[0] is the coldest of the top k
+static void slotsHeatSiftDown(int* heap, uint64_t* scores, int n, int i) {
+    for (;;) {
+        int min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && scores[l] < scores[min])
+            min = l;
+        if (r < n && scores[r] < scores[min])
+            min = r;
+        if (min == i)
+            return;
+        int ts = heap[i];
+        uint64_t tv = scores[i];
+        heap[i] = heap[min], scores[i] = scores[min];
+        heap[min] = ts, scores[min] = tv;
+        i = min;
+    }
+}
+
+// SlotsHeat_TopK
+// fill out the top k (score > 0) hottest slots desc by score, return num
+int SlotsHeat_TopK(int k, int by, int* slots, slot_heat* heats) {
+    uint64_t* scores = RedisModule_Alloc(sizeof(uint64_t) * k);
+    int n = 0;
+    for (uint32_t i = 0; i < g_slots_meta_info.hash_slots_size; i++) {
+        slotHeatDecay(&slots_heat[i]);
+        uint64_t score = slotHeatScore(&slots_heat[i], by);
+        if (score == 0) {
+            continue;
+        }
+        if (n < k) {
+            // sift up
+            int j = n++;
+            slots[j] = (int)i, scores[j] = score;
+            while (j > 0 && scores[(j - 1) / 2] > scores[j]) {
+                int p = (j - 1) / 2;
+                int ts = slots[p];
+                uint64_t tv = scores[p];
+                slots[p] = slots[j], scores[p] = scores[j];
+                slots[j] = ts, scores[j] = tv;
+                j = p;
+            }
+        } else if (score > scores[0]) {
+            slots[0] = (int)i, scores[0] = score;
+            slotsHeatSiftDown(slots, scores, n, 0);
+        }
+    }
+    // pop min to the tail, desc order
+    for (int m = n; m > 1; m--) {
+        int ts = slots[0];
+        uint64_t tv = scores[0];
+        slots[0] = slots[m - 1], scores[0] = scores[m - 1];
+        slots[m - 1] = ts, scores[m - 1] = tv;
+        slotsHeatSiftDown(slots, scores, m - 1, 0);
+    }
+    for (int i = 0; i < n; i++) {
+        heats[i] = slots_heat[slots[i]];
+    }
+    RedisModule_Free(scores);
+    return n;
+}
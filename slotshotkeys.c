@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+typedef struct _db_hotkeys {
+    // count-min sketch rows, estimate key writes in the db
+    uint32_t cms[SLOTS_HOTKEYS_CMS_DEPTH][SLOTS_HOTKEYS_CMS_WIDTH];
+    // min heap by count, heap[0] is the coldest of the top k
+    slots_hotkey heap[SLOTS_HOTKEYS_TOPK];
+    uint64_t hashes[SLOTS_HOTKEYS_TOPK];
+    int n;
+} db_hotkeys;
+
+// per db sketch + top k, alloc on first touch;
+// update and read on main thread or with GIL, no lock.
+static db_hotkeys** dbs_hotkeys = NULL;
+// heat epoch of the last decay
+static uint32_t hotkeys_epoch = 0;
+
+void SlotsHotKeys_Init(void) {
+    dbs_hotkeys
+        = RedisModule_Calloc(g_slots_meta_info.databases, sizeof(db_hotkeys*));
+    hotkeys_epoch = SlotsHeat_Epoch();
+}
+
+static void dbHotKeysClear(db_hotkeys* hk) {
+    for (int i = 0; i < hk->n; i++) {
+        RedisModule_FreeString(NULL, hk->heap[i].key);
+    }
+    memset(hk, 0, sizeof(*hk));
+}
+
+void SlotsHotKeys_Reset(int db) {
+    if (dbs_hotkeys == NULL) {
+        return;
+    }
+    for (int j = 0; j < g_slots_meta_info.databases; j++) {
+        if ((db == -1 || db == j) && dbs_hotkeys[j] != NULL) {
+            dbHotKeysClear(dbs_hotkeys[j]);
+        }
+    }
+}
+
+void SlotsHotKeys_Free(void) {
+    if (dbs_hotkeys == NULL) {
+        return;
+    }
+    for (int j = 0; j < g_slots_meta_info.databases; j++) {
+        if (dbs_hotkeys[j] != NULL) {
+            dbHotKeysClear(dbs_hotkeys[j]);
+            RedisModule_Free(dbs_hotkeys[j]);
+        }
+    }
+    RedisModule_Free(dbs_hotkeys);
+    dbs_hotkeys = NULL;
+}
+
+static void hotKeysSwap(db_hotkeys* hk, int i, int j) {
+    slots_hotkey t = hk->heap[i];
+    uint64_t th = hk->hashes[i];
+    hk->heap[i] = hk->heap[j], hk->hashes[i] = hk->hashes[j];
+    hk->heap[j] = t, hk->hashes[j] = th;
+}
+
+static void hotKeysSiftDown(db_hotkeys* hk, int n, int i) {
+    for (;;) {
+        int min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && hk->heap[l].count < hk->heap[min].count)
+            min = l;
+        if (r < n && hk->heap[r].count < hk->heap[min].count)
+            min = r;
+        if (min == i)
+            return;
+        hotKeysSwap(hk, i, min);
+        i = min;
+    }
+}
+
+static void hotKeysSiftUp(db_hotkeys* hk, int i) {
+    while (i > 0 && hk->heap[(i - 1) / 2].count > hk->heap[i].count) {
+        hotKeysSwap(hk, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+// cmsIncr
+// incr the key counters of all rows, row i index is the i-th
+// log2(width) bits slice of the 64 bits hash, return the min estimate
+static uint32_t cmsIncr(db_hotkeys* hk, uint64_t hash) {
+    uint32_t est = UINT32_MAX;
+    for (int i = 0; i < SLOTS_HOTKEYS_CMS_DEPTH; i++) {
+        uint32_t* c = &hk->cms[i][hash & (SLOTS_HOTKEYS_CMS_WIDTH - 1)];
+        hash >>= SLOTS_HOTKEYS_CMS_WIDTH_BITS;
+        if (*c != UINT32_MAX) {
+            (*c)++;
+        }
+        if (*c < est) {
+            est = *c;
+        }
+    }
+    return est;
+}
+
+// SlotsHotKeys_Touch
+// count a key write with hotkeys_tracking yes, keep the top k estimated keys
+void SlotsHotKeys_Touch(int db, int slot, RedisModuleString* key) {
+    if (!g_slots_meta_info.hotkeys_tracking || dbs_hotkeys == NULL) {
+        return;
+    }
+    db_hotkeys* hk = dbs_hotkeys[db];
+    if (hk == NULL) {
+        hk = dbs_hotkeys[db] = RedisModule_Calloc(1, sizeof(db_hotkeys));
+    }
+    size_t len;
+    const char* kstr = RedisModule_StringPtrLen(key, &len);
+    uint64_t hash = m_dictGenHashFunction(kstr, (int)len);
+    uint32_t est = cmsIncr(hk, hash);
+
+    for (int i = 0; i < hk->n; i++) {
+        if (hk->hashes[i] == hash
+            && RedisModule_StringCompare(hk->heap[i].key, key) == 0) {
+            hk->heap[i].count = est;
+            hotKeysSiftDown(hk, hk->n, i);
+            return;
+        }
+    }
+    if (hk->n < SLOTS_HOTKEYS_TOPK) {
+        int i = hk->n++;
+        hk->heap[i].key = RedisModule_CreateStringFromString(NULL, key);
+        hk->heap[i].slot = slot;
+        hk->heap[i].count = est;
+        hk->hashes[i] = hash;
+        hotKeysSiftUp(hk, i);
+        return;
+    }
+    if (est > hk->heap[0].count) {
+        RedisModule_FreeString(NULL, hk->heap[0].key);
+        hk->heap[0].key = RedisModule_CreateStringFromString(NULL, key);
+        hk->heap[0].slot = slot;
+        hk->heap[0].count = est;
+        hk->hashes[0] = hash;
+        hotKeysSiftDown(hk, hk->n, 0);
+    }
+}
+
+// SlotsHotKeys_Del
+// drop a deleted key from the top k, its sketch counters just decay
+void SlotsHotKeys_Del(int db, RedisModuleString* key) {
+    if (dbs_hotkeys == NULL || dbs_hotkeys[db] == NULL) {
+        return;
+    }
+    db_hotkeys* hk = dbs_hotkeys[db];
+    if (hk->n == 0) {
+        return;
+    }
+    size_t len;
+    const char* kstr = RedisModule_StringPtrLen(key, &len);
+    uint64_t hash = m_dictGenHashFunction(kstr, (int)len);
+    for (int i = 0; i < hk->n; i++) {
+        if (hk->hashes[i] != hash
+            || RedisModule_StringCompare(hk->heap[i].key, key) != 0) {
+            continue;
+        }
+        RedisModule_FreeString(NULL, hk->heap[i].key);
+        hk->n--;
+        if (i != hk->n) {
+            hk->heap[i] = hk->heap[hk->n];
+            hk->hashes[i] = hk->hashes[hk->n];
+            hotKeysSiftDown(hk, hk->n, i);
+            hotKeysSiftUp(hk, i);
+        }
+        return;
+    }
+}
+
+// SlotsHotKeys_Cron
+// halve sketch and top k counts once per heat epoch (heat_halflife_sec),
+// halving keeps the heap order
+void SlotsHotKeys_Cron(void) {
+    uint32_t epoch = SlotsHeat_Epoch();
+    if (epoch == hotkeys_epoch || dbs_hotkeys == NULL) {
+        return;
+    }
+    hotkeys_epoch = epoch;
+    for (int j = 0; j < g_slots_meta_info.databases; j++) {
+        db_hotkeys* hk = dbs_hotkeys[j];
+        if (hk == NULL) {
+            continue;
+        }
+        for (int i = 0; i < SLOTS_HOTKEYS_CMS_DEPTH; i++) {
+            for (int w = 0; w < SLOTS_HOTKEYS_CMS_WIDTH; w++) {
+                hk->cms[i][w] >>= 1;
+            }
+        }
+        for (int i = 0; i < hk->n; i++) {
+            hk->heap[i].count >>= 1;
+        }
+    }
+}
+
+// SlotsHotKeys_Get
+// fill out the db top keys (count > 0) of the slot (-1 all slots) desc by
+// count, keys are refs of the top k, use them before return to event loop
+int SlotsHotKeys_Get(int db, int slot, slots_hotkey* out) {
+    if (dbs_hotkeys == NULL || dbs_hotkeys[db] == NULL) {
+        return 0;
+    }
+    db_hotkeys* hk = dbs_hotkeys[db];
+    int n = 0;
+    for (int i = 0; i < hk->n; i++) {
+        if (hk->heap[i].count == 0 || (slot != -1 && hk->heap[i].slot != slot))
+            continue;
+        // insertion sort desc, n <= SLOTS_HOTKEYS_TOPK
+        int j = n++;
+        while (j > 0 && out[j - 1].count < hk->heap[i].count) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = hk->heap[i];
+    }
+    return n;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+// last bgscan full pass result, read/write with GIL
+static struct {
+    int running;
+    int db;
+    uint64_t* slot_bytes;
+} slots_memory_full = {0, -1, NULL};
+// bgscan thread, joined by the next bgscan or SlotsMemory_Free
+static pthread_t slots_memory_bgscan_tid;
+static int slots_memory_bgscan_joinable = 0;
+static int slots_memory_bgscan_stop = 0;
+
+// keyMemoryUsage
+// MEMORY USAGE key, return 0 if key not exists (maybe expired)
+static long long keyMemoryUsage(RedisModuleCtx* ctx, RedisModuleString* key) {
+    RedisModuleCallReply* reply
+        = RedisModule_Call(ctx, "MEMORY", "cs", "USAGE", key);
+    if (reply == NULL)
+        return 0;
+    long long bytes = 0;
+    if (RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_INTEGER) {
+        bytes = RedisModule_CallReplyInteger(reply);
+    }
+    RedisModule_FreeCallReply(reply);
+    return bytes;
+}
+
+// SlotsMemory_Sample
+// call with GIL, sample keys with m_dictGetSomeKeys,
+// return estimated slot bytes: avg sampled keys MEMORY USAGE * slot keys.
+// keys are used after slot lock unlock: MEMORY USAGE may expire the key,
+// notify Slots_Del need the slot wrlock; the key ref is held by the call argv.
+long long SlotsMemory_Sample(RedisModuleCtx* ctx, int db, int slot,
+                             int samples) {
+    m_dictEntry* des[SLOTS_MEMORY_SAMPLES_MAX];
+    RedisModuleString* keys[SLOTS_MEMORY_SAMPLES_MAX];
+    if (samples > SLOTS_MEMORY_SAMPLES_MAX) {
+        samples = SLOTS_MEMORY_SAMPLES_MAX;
+    }
+
+    // get some keys maybe do a rehash step, so wrlock
+    SLOTKEY_TABLE_WRLOCK(db, slot);
+    dict* d = db_slot_infos[db].slotkey_tables[slot];
+    unsigned long size = dictSize(d);
+    unsigned int n = m_dictGetSomeKeys(d, des, (unsigned int)samples);
+    for (unsigned int i = 0; i < n; i++) {
+        keys[i] = dictGetKey(des[i]);
+    }
+    SLOTKEY_TABLE_UNLOCK(db, slot);
+    if (n == 0) {
+        return 0;
+    }
+
+    long long bytes = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        bytes += keyMemoryUsage(ctx, keys[i]);
+    }
+    return (long long)((double)bytes / n * size);
+}
+
+static void* slotsMemoryBGScanThreadMain(void* arg) {
+    int db = (int)(long)arg;
+    uint32_t size = g_slots_meta_info.hash_slots_size;
+    uint64_t* slot_bytes = RedisModule_Calloc(size, sizeof(uint64_t));
+    list* l = m_listCreate();
+    long long start = RedisModule_Milliseconds();
+
+    RedisModuleCtx* ctx = RedisModule_GetThreadSafeContext(NULL);
+    RedisModule_ThreadSafeContextLock(ctx);
+    RedisModule_SelectDb(ctx, db);
+    RedisModule_ThreadSafeContextUnlock(ctx);
+
+    // hold GIL per scan batch, let other clients run between batches
+    int stopped = 0;
+    for (uint32_t slot = 0; slot < size && !stopped; slot++) {
+        if (__atomic_load_n(&slots_memory_bgscan_stop, __ATOMIC_RELAXED)) {
+            stopped = 1;
+            break;
+        }
+        if (__atomic_load_n(&db_slot_infos[db].slot_key_counts[slot],
+                            __ATOMIC_RELAXED)
+            == 0) {
+            continue;
+        }
+        unsigned long cursor = 0;
+        do {
+            RedisModule_ThreadSafeContextLock(ctx);
+            if (__atomic_load_n(&slots_memory_bgscan_stop, __ATOMIC_RELAXED)) {
+                RedisModule_ThreadSafeContextUnlock(ctx);
+                stopped = 1;
+                break;
+            }
+            cursor = SlotsMGRT_Scan(ctx, slot, SLOTS_MEMORY_SCAN_BATCH, cursor,
+                                    l);
+            m_listIter li;
+            m_listNode* ln;
+            m_listRewind(l, &li);
+            while ((ln = m_listNext(&li)) != NULL) {
+                slot_bytes[slot] += keyMemoryUsage(ctx, listNodeValue(ln));
+            }
+            RedisModule_ThreadSafeContextUnlock(ctx);
+            m_listEmpty(l);
+        } while (cursor != 0);
+    }
+    m_listRelease(l);
+
+    RedisModule_ThreadSafeContextLock(ctx);
+    if (stopped) {
+        RedisModule_Free(slot_bytes);
+    } else {
+        RedisModule_Free(slots_memory_full.slot_bytes);
+        slots_memory_full.slot_bytes = slot_bytes;
+        slots_memory_full.db = db;
+    }
+    slots_memory_full.running = 0;
+    RedisModule_Log(ctx, "notice", "slotsmemory bgscan db %d %s cost %lld ms",
+                    db, stopped ? "stopped" : "done",
+                    RedisModule_Milliseconds() - start);
+    RedisModule_ThreadSafeContextUnlock(ctx);
+    RedisModule_FreeThreadSafeContext(ctx);
+    return NULL;
+}
+
+// SlotsMemory_BGScan
+// call with GIL, start a worker thread to sum MEMORY USAGE of all keys per
+// slot in db, return REDISMODULE_ERR if a bgscan is running.
+int SlotsMemory_BGScan(RedisModuleCtx* ctx, int db) {
+    if (slots_memory_full.running) {
+        return REDISMODULE_ERR;
+    }
+    // the last one has published its result, it's exiting
+    if (slots_memory_bgscan_joinable) {
+        pthread_join(slots_memory_bgscan_tid, NULL);
+        slots_memory_bgscan_joinable = 0;
+    }
+    slots_memory_bgscan_stop = 0;
+    if (pthread_create(&slots_memory_bgscan_tid, NULL,
+                       slotsMemoryBGScanThreadMain, (void*)(long)db)
+        != 0) {
+        RedisModule_Log(ctx, "warning",
+                        "slotsmemory bgscan can't start thread");
+        return REDISMODULE_ERR;
+    }
+    slots_memory_bgscan_joinable = 1;
+    slots_memory_full.running = 1;
+    return REDISMODULE_OK;
+}
+
+// SlotsMemory_Free
+// call with GIL before Slots_Free (unload/shutdown), stop and join the
+// bgscan thread, it reads the db slot infos; the GIL is released while
+// joining, the thread takes it per scan batch.
+void SlotsMemory_Free(RedisModuleCtx* ctx) {
+    if (slots_memory_bgscan_joinable) {
+        __atomic_store_n(&slots_memory_bgscan_stop, 1, __ATOMIC_RELAXED);
+        RedisModule_ThreadSafeContextUnlock(ctx);
+        pthread_join(slots_memory_bgscan_tid, NULL);
+        RedisModule_ThreadSafeContextLock(ctx);
+        slots_memory_bgscan_joinable = 0;
+    }
+    RedisModule_Free(slots_memory_full.slot_bytes);
+    slots_memory_full.slot_bytes = NULL;
+    slots_memory_full.db = -1;
+    slots_memory_full.running = 0;
+}
+
+// SlotsMemory_FullResult
+// call with GIL, return the last bgscan per slot bytes of db, NULL if none
+const uint64_t* SlotsMemory_FullResult(int db) {
+    if (slots_memory_full.db != db) {
+        return NULL;
+    }
+    return slots_memory_full.slot_bytes;
+}
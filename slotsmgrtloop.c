@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+// witheventloop mgrt: send slotsrestorebin batches with hiredis async api
+// attached to the redis event loop (RedisModule_EventLoopAdd, redis >= 7.0),
+// the cmd blocks the client, batches are written when the socket is
+// writable, acks are read by callbacks, the migrated keys are deleted when
+// all acks are ok. the main thread never waits on the network, no threads.
+#define SLOTS_MGRT_LOOP_ERRORMSG \
+    "ERR witheventloop mgrt need redis >= 7.0 module event loop api"
+
+#ifdef REDISMODULE_EVENTLOOP_READABLE
+#include "hiredis/adapters/redismoduleapi.h"
+
+// async conns cache, {host}:{port} or unix:{path} -> conn,
+// only used on the main thread
+static RedisModuleDict* slotsmgrt_loop_conns = NULL;
+// timers ctx for the hiredis adapter
+static RedisModuleCtx* slotsmgrt_loop_ctx = NULL;
+
+typedef struct _slots_mgrt_loop_conn {
+    sds name;
+    redisAsyncContext* ac;
+    time_t last_time;
+    // pending jobs, don't close it when idle timeout; jobs hold the conn,
+    // a closed conn (ac NULL) is freed when its last job is done
+    int jobs;
+} slots_mgrt_loop_conn;
+
+typedef struct _slots_mgrt_loop_job {
+    RedisModuleBlockedClient* bc;
+    slots_mgrt_loop_conn* conn;
+    int db;
+    // slotsmgrtslot/slotsmgrttagslot reply [moved, left], slot < 0 int
+    int slot;
+    // dumped keys (retained), unlink them when all batches acked
+    RedisModuleString** keys;
+    int n;
+    size_t bytes;
+    // sent cmds (select + batches) wait for the ack
+    int pending;
+    int err;
+    int moved;
+    int left;
+    uint64_t start_ns;
+} slots_mgrt_loop_job;
+
+static time_t loopUnixtime(void) {
+    return (time_t)(RedisModule_Milliseconds() / 1000);
+}
+
+static void loopConnFree(slots_mgrt_loop_conn* conn) {
+    sdsfree(conn->name);
+    RedisModule_Free(conn);
+}
+
+// loopConnRemove
+// the ac is freed by hiredis: drop the conn from the cache, mark it closed,
+// pending cmds callbacks (with NULL reply) may run after this (connect
+// failure/timeout), so free it only if no job holds it.
+static void loopConnRemove(const redisAsyncContext* ac) {
+    slots_mgrt_loop_conn* conn = ac->data;
+    if (conn == NULL) {
+        return;
+    }
+    if (slotsmgrt_loop_conns != NULL) {
+        slots_mgrt_loop_conn* cached = RedisModule_DictGetC(
+            slotsmgrt_loop_conns, conn->name, sdslen(conn->name), NULL);
+        if (cached == conn) {
+            RedisModule_DictDelC(slotsmgrt_loop_conns, conn->name,
+                                 sdslen(conn->name), NULL);
+        }
+    }
+    ((redisAsyncContext*)ac)->data = NULL;
+    conn->ac = NULL;
+    MGRT_STATS_INCR(conns_closed, 1);
+    if (conn->jobs == 0) {
+        loopConnFree(conn);
+    }
+}
+
+static void loopConnectCallback(const redisAsyncContext* ac, int status) {
+    if (status != REDIS_OK) {
+        RedisModule_Log(slotsmgrt_loop_ctx, "warning",
+                        "slotsmgrt: eventloop connect error = '%s'",
+                        ac->errstr);
+        MGRT_STATS_INCR(conn_errors, 1);
+        // hiredis frees the ac, pending cmds callback with NULL reply
+        // after this, the jobs free the conn
+        loopConnRemove(ac);
+    }
+}
+
+static void loopDisconnectCallback(const redisAsyncContext* ac, int status) {
+    if (status != REDIS_OK) {
+        RedisModule_Log(slotsmgrt_loop_ctx, "warning",
+                        "slotsmgrt: eventloop disconnect error = '%s'",
+                        ac->errstr);
+    }
+    loopConnRemove(ac);
+}
+
+static slots_mgrt_loop_conn* loopGetConn(RedisModuleCtx* ctx,
+                                         const char* host, const char* port,
+                                         time_t timeoutMS) {
+    if (slotsmgrt_loop_conns == NULL) {
+        slotsmgrt_loop_conns = RedisModule_CreateDict(NULL);
+        slotsmgrt_loop_ctx = RedisModule_GetDetachedThreadSafeContext(ctx);
+    }
+    sds name = SlotsMGRT_TargetName(host, port);
+    slots_mgrt_loop_conn* conn
+        = RedisModule_DictGetC(slotsmgrt_loop_conns, name, sdslen(name), NULL);
+    if (conn != NULL) {
+        sdsfree(name);
+        conn->last_time = loopUnixtime();
+        return conn;
+    }
+
+    struct timeval timeout
+        = {.tv_sec = timeoutMS / 1000, .tv_usec = (timeoutMS % 1000) * 1000};
+    redisOptions options = {0};
+    const char* path = SlotsMGRT_UnixPath(host);
+    if (path != NULL) {
+        REDIS_OPTIONS_SET_UNIX(&options, path);
+    } else {
+        REDIS_OPTIONS_SET_TCP(&options, host, atoi(port));
+    }
+    if (timeoutMS > 0) {
+        options.connect_timeout = &timeout;
+    }
+    redisAsyncContext* ac = redisAsyncConnectWithOptions(&options);
+    if (ac == NULL || ac->err
+        || redisModuleAttach(ac, slotsmgrt_loop_ctx) != REDIS_OK) {
+        RedisModule_Log(ctx, "warning",
+                        "Err: slotsmgrt eventloop connect to target %s, "
+                        "error = '%s'",
+                        name,
+                        ac != NULL ? ac->errstr
+                                   : "can't allocate redis async context");
+        MGRT_STATS_INCR(conn_errors, 1);
+        if (ac != NULL) {
+            redisAsyncFree(ac);
+        }
+        sdsfree(name);
+        return NULL;
+    }
+    // r/w timeout, pending cmds callback with NULL reply when timeout
+    if (timeoutMS > 0) {
+        redisAsyncSetTimeout(ac, timeout);
+    }
+    redisAsyncSetConnectCallback(ac, loopConnectCallback);
+    redisAsyncSetDisconnectCallback(ac, loopDisconnectCallback);
+    MGRT_STATS_INCR(conns_created, 1);
+    RedisModule_Log(ctx, "verbose",
+                    "slotsmgrt: eventloop connect to target %s set timeout: "
+                    "%ld.%ld s",
+                    name, timeout.tv_sec, (long int)timeout.tv_usec);
+
+    conn = RedisModule_Alloc(sizeof(slots_mgrt_loop_conn));
+    conn->name = name;
+    conn->ac = ac;
+    conn->last_time = loopUnixtime();
+    conn->jobs = 0;
+    ac->data = conn;
+    RedisModule_DictSetC(slotsmgrt_loop_conns, name, sdslen(name), conn);
+    return conn;
+}
+
+static int loopJobReply(RedisModuleCtx* ctx, RedisModuleString** argv,
+                        int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    slots_mgrt_loop_job* job = RedisModule_GetBlockedClientPrivateData(ctx);
+    if (job->err) {
+        return RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_MGRT);
+    }
+    if (job->slot < 0) {
+        return RedisModule_ReplyWithLongLong(ctx, job->moved);
+    }
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithLongLong(ctx, job->moved);
+    RedisModule_ReplyWithLongLong(ctx, job->left);
+    return REDISMODULE_OK;
+}
+
+static void loopJobFree(RedisModuleCtx* ctx, void* privdata) {
+    slots_mgrt_loop_job* job = privdata;
+    for (int i = 0; i < job->n; i++) {
+        RedisModule_FreeString(ctx, job->keys[i]);
+    }
+    RedisModule_Free(job->keys);
+    RedisModule_Free(job);
+}
+
+// loopJobDone
+// all cmds acked (or failed), on the main thread with the GIL held:
+// del the migrated keys and unblock the client
+static void loopJobDone(slots_mgrt_loop_job* job) {
+    double cost_us;
+    if (job->conn != NULL) {
+        // the last job of a closed conn free it
+        if (--job->conn->jobs == 0 && job->conn->ac == NULL) {
+            loopConnFree(job->conn);
+        }
+        job->conn = NULL;
+    }
+    if (job->err) {
+        MGRT_STATS_INCR(send_errors, 1);
+        MGRT_STATS_DECR(inflight_batches, 1);
+        RedisModule_UnblockClient(job->bc, job);
+        return;
+    }
+    cost_us = (SlotsLatency_NowNs() - job->start_ns) / 1e3;
+    SlotsMGRT_LatencyHistAdd(&g_slots_mgrt_stats.send_latency, cost_us);
+    MGRT_STATS_INCR(keys_migrated, job->n);
+    MGRT_STATS_INCR(bytes_migrated, job->bytes);
+
+    RedisModuleCtx* ctx = RedisModule_GetThreadSafeContext(job->bc);
+    RedisModule_SelectDb(ctx, job->db);
+    uint64_t start_ns = SlotsLatency_NowNs();
+    slots_async_inline = 1;
+    int ret = SlotsMGRT_DelKeys(ctx, job->keys, job->n);
+    slots_async_inline = 0;
+    MGRT_STATS_DECR(inflight_batches, 1);
+    if (ret == SLOTS_MGRT_ERR) {
+        MGRT_STATS_INCR(del_errors, 1);
+        job->err = 1;
+    } else {
+        cost_us = (SlotsLatency_NowNs() - start_ns) / 1e3;
+        SlotsMGRT_LatencyHistAdd(&g_slots_mgrt_stats.del_latency, cost_us);
+        MGRT_STATS_INCR(keys_deleted, ret);
+        job->moved = ret;
+    }
+    RedisModule_FreeThreadSafeContext(ctx);
+
+    if (job->slot >= 0) {
+        SLOTKEY_TABLE_RDLOCK(job->db, job->slot);
+        job->left = dictSize(db_slot_infos[job->db].slotkey_tables[job->slot]);
+        SLOTKEY_TABLE_UNLOCK(job->db, job->slot);
+    }
+    RedisModule_UnblockClient(job->bc, job);
+}
+
+static void loopJobDoneTimer(RedisModuleCtx* ctx, void* data) {
+    REDISMODULE_NOT_USED(ctx);
+    loopJobDone(data);
+}
+
+static void loopReplyCallback(redisAsyncContext* ac, void* r, void* privdata) {
+    redisReply* reply = r;
+    slots_mgrt_loop_job* job = privdata;
+    if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+        if (!job->err) {
+            RedisModule_Log(slotsmgrt_loop_ctx, "warning",
+                            "slotsmgrt: eventloop send fail, error = '%s'",
+                            reply != NULL ? reply->str : ac->errstr);
+        }
+        job->err = 1;
+    }
+    if (--job->pending == 0) {
+        // acks read when a sync cmd yield, the cmd may still use the slot
+        // index keys, del them from the next event loop timer
+        if (slots_yielding) {
+            RedisModule_CreateTimer(slotsmgrt_loop_ctx, 0, loopJobDoneTimer,
+                                    job);
+            return;
+        }
+        loopJobDone(job);
+    }
+}
+
+// loopSendBatches
+// queue select db + slotsrestorebin batches split by batch_bytes,
+// hiredis formats cmds to the conn obuf, written when the fd is writable.
+static void loopSendBatches(slots_mgrt_loop_job* job, rdb_dump_obj* objs[],
+                            int n, int compress, size_t batch_bytes) {
+    redisAsyncContext* ac = job->conn->ac;
+    if (redisAsyncCommand(ac, loopReplyCallback, job, "SELECT %d", job->db)
+        != REDIS_OK) {
+        job->err = 1;
+        return;
+    }
+    job->pending++;
+
+    const char* argv[2] = {"SLOTSRESTOREBIN", NULL};
+    size_t argvlen[2] = {15, 0};
+    size_t cmd_size = 0;
+    int start_pos = 0;
+    for (int i = 0; i <= n; i++) {
+        if (i == n || cmd_size > batch_bytes) {
+            char* buf
+                = RedisModule_Alloc(SlotsBatch_EncodeBound(objs, start_pos, i));
+            argv[1] = buf;
+            argvlen[1] = SlotsBatch_Encode(objs, start_pos, i, compress, buf);
+            int r = redisAsyncCommandArgv(ac, loopReplyCallback, job, 2, argv,
+                                          argvlen);
+            RedisModule_Free(buf);
+            if (r != REDIS_OK) {
+                job->err = 1;
+                return;
+            }
+            job->pending++;
+            cmd_size = 0;
+            start_pos = i;
+        }
+        if (i < n) {
+            size_t ksz, vsz;
+            RedisModule_StringPtrLen(objs[i]->key, &ksz);
+            RedisModule_StringPtrLen(objs[i]->val, &vsz);
+            cmd_size += ksz + vsz;
+        }
+    }
+}
+
+/* *
+ * slotsmgrtone|slotsmgrttagone host port timeout key witheventloop[,...]
+ * slotsmgrtslot|slotsmgrttagslot host port timeout slot witheventloop[,...]
+ * */
+int SlotsMGRTLoop_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                               int argc) {
+    if (argc != 6)
+        return RedisModule_WrongArity(ctx);
+    // module api is loaded at runtime, redis < 7.0 don't export it
+    if (redisModuleCompatibilityCheck() != REDIS_OK) {
+        return RedisModule_ReplyWithError(ctx, SLOTS_MGRT_LOOP_ERRORMSG);
+    }
+
+    const char* cmd = RedisModule_StringPtrLen(argv[0], NULL);
+    int withtag = strncasecmp(cmd, "slotsmgrttag", 12) == 0;
+    int withslot = strcasecmp(cmd, "slotsmgrtslot") == 0
+                   || strcasecmp(cmd, "slotsmgrttagslot") == 0;
+    const char* host = RedisModule_StringPtrLen(argv[1], NULL);
+    const char* port = RedisModule_StringPtrLen(argv[2], NULL);
+    long long timeout = 0;
+    if (RedisModule_StringToLongLong(argv[3], &timeout) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+    long long slot = -1;
+    RedisModuleString* key = argv[4];
+    if (withslot) {
+        if (RedisModule_StringToLongLong(argv[4], &slot) != REDISMODULE_OK
+            || slot < 0 || slot >= g_slots_meta_info.hash_slots_size) {
+            RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        key = NULL;
+    }
+    int flags = SlotsMGRT_ParseFlags(RedisModule_StringPtrLen(argv[5], NULL));
+    int db = RedisModule_GetSelectedDb(ctx);
+
+    RedisModuleString** keys = NULL;
+    int n = SlotsMGRT_GetMgrtKeys(ctx, (int)slot, key, withtag, &keys);
+    rdb_dump_obj** objs = n > 0 ? RedisModule_Calloc(n, sizeof(rdb_dump_obj*))
+                                : NULL;
+    int ret = 0;
+    if (n > 0) {
+        uint64_t start_ns = SlotsLatency_NowNs();
+        slots_async_inline = 1;
+        ret = SlotsMGRT_DumpKeys(ctx, keys, n, objs);
+        slots_async_inline = 0;
+        SlotsMGRT_LatencyHistAdd(&g_slots_mgrt_stats.dump_latency,
+                                 (SlotsLatency_NowNs() - start_ns) / 1e3);
+        RedisModule_Free(keys);
+    }
+    if (ret == SLOTS_MGRT_ERR) {
+        FreeDumpObjs(ctx, objs, n);
+        MGRT_STATS_INCR(dump_errors, 1);
+        RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_MGRT);
+        return REDISMODULE_ERR;
+    }
+    if (ret == 0) {
+        FreeDumpObjs(ctx, objs, n);
+        if (!withslot) {
+            return RedisModule_ReplyWithLongLong(ctx, 0);
+        }
+        int left = 0;
+        if (slot >= 0) {
+            SLOTKEY_TABLE_RDLOCK(db, slot);
+            left = dictSize(db_slot_infos[db].slotkey_tables[slot]);
+            SLOTKEY_TABLE_UNLOCK(db, slot);
+        }
+        RedisModule_ReplyWithArray(ctx, 2);
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        RedisModule_ReplyWithLongLong(ctx, left);
+        return REDISMODULE_OK;
+    }
+
+    slots_mgrt_loop_conn* conn = loopGetConn(ctx, host, port, timeout);
+    if (conn == NULL) {
+        FreeDumpObjs(ctx, objs, n);
+        RedisModule_ReplyWithError(ctx, REDISXSLOT_ERRORMSG_MGRT);
+        return REDISMODULE_ERR;
+    }
+    // todo auth
+
+    MGRT_STATS_INCR(batches, 1);
+    MGRT_STATS_INCR(inflight_batches, 1);
+    slots_mgrt_loop_job* job = RedisModule_Calloc(1, sizeof(*job));
+    job->bc = RedisModule_BlockClient(ctx, loopJobReply, NULL, loopJobFree, 0);
+    job->conn = conn;
+    job->db = db;
+    job->slot = withslot ? (int)slot : -1;
+    job->n = ret;
+    job->keys = RedisModule_Alloc(sizeof(RedisModuleString*) * ret);
+    for (int i = 0; i < ret; i++) {
+        size_t ksz, vsz;
+        RedisModule_StringPtrLen(objs[i]->key, &ksz);
+        RedisModule_StringPtrLen(objs[i]->val, &vsz);
+        job->bytes += ksz + vsz;
+        job->keys[i] = RedisModule_CreateStringFromString(NULL, objs[i]->key);
+    }
+    job->start_ns = SlotsLatency_NowNs();
+    conn->jobs++;
+
+    size_t batch_bytes = REDIS_MGRT_CMD_PARAMS_SIZE;
+    if (g_slots_meta_info.mgrt_batch_budget_us > 0) {
+        SlotsMGRT_GetBatchSize(NULL, &batch_bytes);
+    }
+    loopSendBatches(job, objs, ret, flags & SLOTS_MGRT_COMPRESS, batch_bytes);
+    FreeDumpObjs(ctx, objs, n);
+    if (job->pending == 0) {
+        loopJobDone(job);
+    }
+    return REDISMODULE_OK;
+}
+
+// SlotsMGRTLoop_CloseTimedoutConns
+// for server cron job to close idle eventloop conns
+void SlotsMGRTLoop_CloseTimedoutConns(RedisModuleCtx* ctx) {
+    if (slotsmgrt_loop_conns == NULL) {
+        return;
+    }
+    time_t unixtime = loopUnixtime();
+    RedisModuleDictIter* di
+        = RedisModule_DictIteratorStartC(slotsmgrt_loop_conns, "^", NULL, 0);
+    slots_mgrt_loop_conn* conn;
+    while (RedisModule_DictNextC(di, NULL, (void**)&conn) != NULL) {
+        if (conn->jobs == 0
+            && (unixtime - conn->last_time) > MGRT_BATCH_KEY_TIMEOUT) {
+            RedisModule_Log(ctx, "notice",
+                            "slotsmgrt: eventloop timeout target %s, "
+                            "lasttime = %ld, now = %ld",
+                            conn->name, conn->last_time, unixtime);
+            MGRT_STATS_INCR(conns_timedout, 1);
+            // disconnect callback frees the conn, restart the iter
+            RedisModule_DictIteratorStop(di);
+            RedisModule_DictDelC(slotsmgrt_loop_conns, conn->name,
+                                 sdslen(conn->name), NULL);
+            redisAsyncDisconnect(conn->ac);
+            di = RedisModule_DictIteratorStartC(slotsmgrt_loop_conns, "^",
+                                                NULL, 0);
+        }
+    }
+    RedisModule_DictIteratorStop(di);
+}
+
+uint64_t SlotsMGRTLoop_ConnsNum(void) {
+    return slotsmgrt_loop_conns != NULL
+               ? RedisModule_DictSize(slotsmgrt_loop_conns)
+               : 0;
+}
+
+void SlotsMGRTLoop_Free(void) {
+    if (slotsmgrt_loop_conns == NULL) {
+        return;
+    }
+    RedisModuleDictIter* di
+        = RedisModule_DictIteratorStartC(slotsmgrt_loop_conns, "^", NULL, 0);
+    slots_mgrt_loop_conn* conn;
+    while (RedisModule_DictNextC(di, NULL, (void**)&conn) != NULL) {
+        // pending jobs are done with NULL reply, conn->ac is still set,
+        // so they don't free the conn
+        conn->ac->data = NULL;
+        redisAsyncFree(conn->ac);
+        loopConnFree(conn);
+    }
+    RedisModule_DictIteratorStop(di);
+    RedisModule_FreeDict(NULL, slotsmgrt_loop_conns);
+    slotsmgrt_loop_conns = NULL;
+    RedisModule_FreeThreadSafeContext(slotsmgrt_loop_ctx);
+    slotsmgrt_loop_ctx = NULL;
+}
+
+#else
+
+int SlotsMGRTLoop_RedisCommand(RedisModuleCtx* ctx, RedisModuleString** argv,
+                               int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    return RedisModule_ReplyWithError(ctx, SLOTS_MGRT_LOOP_ERRORMSG);
+}
+
+void SlotsMGRTLoop_CloseTimedoutConns(RedisModuleCtx* ctx) {
+    REDISMODULE_NOT_USED(ctx);
+}
+
+uint64_t SlotsMGRTLoop_ConnsNum(void) {
+    return 0;
+}
+
+void SlotsMGRTLoop_Free(void) {
+}
+
+#endif
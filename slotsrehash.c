@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+// background rehasher thread, do dirty slot dicts rehash steps with the slot
+// wrlock instead of 1ms per cron loop on main thread
+static pthread_t bg_rehash_tid;
+static int bg_rehash_running = 0;
+static int bg_rehash_stop = 0;
+// set by cron: activerehashing no or have active child (bgsave/aofrw),
+// rehash touch all buckets, cow pages of child
+static int bg_rehash_paused = 1;
+
+void SlotsRehash_SetPaused(int paused) {
+    __atomic_store_n(&bg_rehash_paused, paused, __ATOMIC_RELAXED);
+}
+
+static inline int bgRehashStopped(void) {
+    return __atomic_load_n(&bg_rehash_stop, __ATOMIC_RELAXED)
+           || __atomic_load_n(&bg_rehash_paused, __ATOMIC_RELAXED);
+}
+
+// bgRehashDb
+// rehash steps for the db dirty slots which are rehashing, return work done
+static int bgRehashDb(int db) {
+    int work_done = 0;
+    uint32_t words = SLOTS_BITMAP_WORDS(g_slots_meta_info.hash_slots_size);
+    uint64_t* dirty = db_slot_infos[db].slot_dirty_bitmap;
+    for (uint32_t w = 0; w < words; w++) {
+        uint64_t bits = __atomic_load_n(&dirty[w], __ATOMIC_RELAXED);
+        while (bits) {
+            if (bgRehashStopped()) {
+                return work_done;
+            }
+            int slot = (int)(w << 6) + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            SLOTKEY_TABLE_WRLOCK(db, slot);
+            // small steps, don't hold the slot wrlock long for main thread
+            while (m_dictRehash(db_slot_infos[db].slotkey_tables[slot],
+                                SLOTS_BG_REHASH_STEPS)) {
+                work_done = 1;
+                SLOTKEY_TABLE_UNLOCK(db, slot);
+                // a big dict takes long, stop/pause (fork child) between
+                // steps, the slot stays dirty to go on later
+                if (bgRehashStopped()) {
+                    return work_done;
+                }
+                SLOTKEY_TABLE_WRLOCK(db, slot);
+            }
+            SLOTKEY_TABLE_UNLOCK(db, slot);
+        }
+    }
+    return work_done;
+}
+
+static void* bgRehashThreadMain(void* arg) {
+    UNUSED(arg);
+    if (g_slots_meta_info.bg_rehash_cpulist != NULL) {
+        SlotsMGRT_SetCpuAffinity(g_slots_meta_info.bg_rehash_cpulist);
+    }
+    while (!__atomic_load_n(&bg_rehash_stop, __ATOMIC_RELAXED)) {
+        int work_done = 0;
+        if (!__atomic_load_n(&bg_rehash_paused, __ATOMIC_RELAXED)) {
+            for (int db = 0; db < g_slots_meta_info.databases; db++) {
+                if (__atomic_load_n(&db_slot_infos[db].slot_dirty_num,
+                                    __ATOMIC_RELAXED)
+                    == 0) {
+                    continue;
+                }
+                work_done |= bgRehashDb(db);
+            }
+        }
+        if (!work_done) {
+            usleep(SLOTS_BG_REHASH_IDLE_US);
+        }
+    }
+    return NULL;
+}
+
+int SlotsRehash_Start(void) {
+    if (bg_rehash_running) {
+        return REDISMODULE_OK;
+    }
+    bg_rehash_stop = 0;
+    if (pthread_create(&bg_rehash_tid, NULL, bgRehashThreadMain, NULL) != 0) {
+        return REDISMODULE_ERR;
+    }
+    bg_rehash_running = 1;
+    return REDISMODULE_OK;
+}
+
+void SlotsRehash_Stop(void) {
+    if (!bg_rehash_running) {
+        return;
+    }
+    __atomic_store_n(&bg_rehash_stop, 1, __ATOMIC_RELAXED);
+    pthread_join(bg_rehash_tid, NULL);
+    bg_rehash_running = 0;
+}
+
+int SlotsRehash_Running(void) {
+    return bg_rehash_running;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "redisxslot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// withshm mgrt between co-located instances: the source encodes
+// slotsrestorebin batches into a shm ring of the mgrt conn and only sends
+// `slotsrestoreshm name offset len` descriptors on the conn, the target maps
+// the batch region read only and restores in place, so the batch payload is
+// not copied through the socket buffers.
+
+static uint64_t slots_shm_seq = 0;
+
+// SlotsShm_RingCreate
+// create a /redisxslot-{pid}-{seq} shm segment of size bytes (owner rw only)
+// and map it, return NULL if err (errno is set)
+slots_shm_ring* SlotsShm_RingCreate(size_t size) {
+    slots_shm_ring* ring = RedisModule_Calloc(1, sizeof(slots_shm_ring));
+    uint64_t seq = __atomic_fetch_add(&slots_shm_seq, 1, __ATOMIC_RELAXED);
+    snprintf(ring->name, sizeof(ring->name), "%s%ld-%" PRIu64,
+             SLOTS_SHM_PREFIX, (long)getpid(), seq);
+    int fd = shm_open(ring->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        RedisModule_Free(ring);
+        return NULL;
+    }
+    // tmpfs ftruncate is sparse, a write past the /dev/shm limit is SIGBUS,
+    // reserve the pages at create (err like other create errs)
+    int ret = ftruncate(fd, (off_t)size);
+#ifdef __linux__
+    if (ret == 0) {
+        ret = posix_fallocate(fd, 0, (off_t)size);
+        if (ret != 0) {
+            errno = ret;
+            ret = -1;
+        }
+    }
+#endif
+    if (ret == -1) {
+        int err = errno;
+        close(fd);
+        shm_unlink(ring->name);
+        RedisModule_Free(ring);
+        errno = err;
+        return NULL;
+    }
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(ring->name);
+        RedisModule_Free(ring);
+        errno = err;
+        return NULL;
+    }
+    ring->base = base;
+    ring->size = size;
+    return ring;
+}
+
+void SlotsShm_RingFree(slots_shm_ring* ring) {
+    if (ring == NULL) {
+        return;
+    }
+    munmap(ring->base, ring->size);
+    shm_unlink(ring->name);
+    RedisModule_Free(ring);
+}
+
+// SlotsShm_RingReserve
+// reserve len contiguous bytes at *off to write a batch, a batch don't wrap,
+// skip the ring tail if it's too short. return NULL if the free bytes are
+// not enough now (wait acks then retry), len must be <= ring size.
+char* SlotsShm_RingReserve(slots_shm_ring* ring, size_t len, size_t* off) {
+    if (ring->wpos == ring->rpos) {
+        // empty, restart from the ring head
+        ring->wpos = ring->rpos
+            = (ring->wpos + ring->size - 1) / ring->size * ring->size;
+    }
+    size_t pos = ring->wpos % ring->size;
+    size_t pad = pos + len > ring->size ? ring->size - pos : 0;
+    if (ring->wpos - ring->rpos + pad + len > ring->size) {
+        return NULL;
+    }
+    ring->wpos += pad;
+    *off = ring->wpos % ring->size;
+    return ring->base + *off;
+}
+
+// SlotsShm_RingCommit
+// the reserved batch is written with len (<= reserved len) bytes
+void SlotsShm_RingCommit(slots_shm_ring* ring, size_t len) {
+    ring->wpos += len;
+}
+
+// SlotsShm_RingRelease
+// batches before pos are acked (restored), free their bytes
+void SlotsShm_RingRelease(slots_shm_ring* ring, uint64_t pos) {
+    if (pos > ring->rpos) {
+        ring->rpos = pos;
+    }
+}
+
+// SlotsShm_Map
+// target map [off, off + len) of the shm segment name read only,
+// return the batch pointer, NULL if the name isn't a redisxslot ring or the
+// range is invalid; unmap (*map, *maplen) with SlotsShm_Unmap.
+const char* SlotsShm_Map(const char* name, long long off, long long len,
+                         void** map, size_t* maplen) {
+    size_t plen = strlen(SLOTS_SHM_PREFIX);
+    if (strncmp(name, SLOTS_SHM_PREFIX, plen) != 0
+        || strchr(name + plen, '/') != NULL || off < 0 || len <= 0) {
+        return NULL;
+    }
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || off > (long long)st.st_size
+        || len > (long long)st.st_size - off) {
+        close(fd);
+        return NULL;
+    }
+    long long page = sysconf(_SC_PAGESIZE);
+    long long moff = off / page * page;
+    *maplen = (size_t)(off - moff + len);
+    *map = mmap(NULL, *maplen, PROT_READ, MAP_SHARED, fd, (off_t)moff);
+    close(fd);
+    if (*map == MAP_FAILED) {
+        *map = NULL;
+        return NULL;
+    }
+    return (const char*)*map + (off - moff);
+}
+
+void SlotsShm_Unmap(void* map, size_t maplen) {
+    if (map != NULL) {
+        munmap(map, maplen);
+    }
+}
@@ -0,0 +1,195 @@
+#!/bin/bash
+# e2e mgrt benchmark:
+# start src/dst redis-server with redisxslot module loaded, populate keys,
+# migrate all slots to dst with sync/async/pool/withpipeline/withcompress/
+# withbinary/witheventloop/withshm mode, report keys/s, MB/s and src
+# client-visible p99 latency (redis-benchmark get) before and during migration.
+# usage: bash tests/bench/mgrt_bench.sh [redis_path]
+# params from env, like this: KEYS=1000000 TAGS=100 MODES="sync pool" bash ...
+set -e
+
+work_path=$(pwd)
+module_path=$work_path/redisxslot.so
+redis_path=$work_path/redis
+if [[ -n $1 ]];then redis_path=$1;fi
+redis_server=$redis_path/src/redis-server
+redis_cli=$redis_path/src/redis-cli
+redis_benchmark=$redis_path/src/redis-benchmark
+
+SRC_PORT=${SRC_PORT:-16390}
+DST_PORT=${DST_PORT:-16391}
+SLOTS=${SLOTS:-1024}
+# thread pool size for pool mode
+THREADS=${THREADS:-4}
+KEYS=${KEYS:-100000}
+# value bytes (string value, hash/list/set/zset field value)
+VAL_SIZE=${VAL_SIZE:-128}
+# string|hash|list|set|zset
+KEY_TYPE=${KEY_TYPE:-string}
+# fields/members per hash/list/set/zset key
+FIELDS=${FIELDS:-8}
+# 0 no hash tag key, use slotsmgrtslot; >0 hash tag num, use slotsmgrttagslot
+TAGS=${TAGS:-0}
+MODES=${MODES:-"sync async pool withpipeline"}
+MGRT_TIMEOUT=${MGRT_TIMEOUT:-30000}
+LAT_CLIENTS=${LAT_CLIENTS:-10}
+LAT_REQUESTS=${LAT_REQUESTS:-10000}
+BENCH_DIR=${BENCH_DIR:-/tmp/redisxslot_mgrt_bench}
+
+for bin in $redis_server $redis_cli $redis_benchmark $module_path;do
+    if [[ ! -e $bin ]];then
+        echo "$bin not found, make redis and redisxslot first"
+        exit 1
+    fi
+done
+mkdir -p $BENCH_DIR
+
+start_server() {
+    local port=$1
+    shift
+    $redis_server --port $port --daemonize yes --dir $BENCH_DIR \
+        --save "" --appendonly no \
+        --pidfile $BENCH_DIR/$port.pid --logfile $BENCH_DIR/$port.log \
+        --loadmodule $module_path "$@"
+    for i in $(seq 1 50);do
+        if [[ $($redis_cli -p $port ping 2>/dev/null) == "PONG" ]];then
+            return 0
+        fi
+        sleep 0.1
+    done
+    echo "start redis-server $port fail, see $BENCH_DIR/$port.log"
+    exit 1
+}
+
+stop_server() {
+    $redis_cli -p $1 shutdown nosave >/dev/null 2>&1 || true
+    sleep 0.2
+}
+
+# populate keys with redis-cli --pipe
+populate() {
+    awk -v keys=$KEYS -v tags=$TAGS -v type=$KEY_TYPE -v fields=$FIELDS \
+        -v vsize=$VAL_SIZE '
+    function bulk(s) { return "$" length(s) "\r\n" s "\r\n" }
+    BEGIN {
+        for (k = 0; k < vsize; k++) val = val "x"
+        cmd["string"] = "SET"; cmd["hash"] = "HSET"; cmd["list"] = "RPUSH"
+        cmd["set"] = "SADD"; cmd["zset"] = "ZADD"
+        for (i = 0; i < keys; i++) {
+            key = "key:" i
+            if (tags > 0) key = "{tag" (i % tags) "}:" key
+            if (type == "string") {
+                printf "*3\r\n%s%s%s", bulk(cmd[type]), bulk(key), bulk(val)
+                continue
+            }
+            n = (type == "hash" || type == "zset") ? 2 + 2 * fields \
+                                                   : 2 + fields
+            printf "*%d\r\n%s%s", n, bulk(cmd[type]), bulk(key)
+            for (j = 0; j < fields; j++) {
+                if (type == "hash") printf "%s%s", bulk("f" j), bulk(val)
+                else if (type == "zset") printf "%s%s", bulk(j), bulk(j ":" val)
+                else if (type == "set") printf "%s", bulk(j ":" val)
+                else printf "%s", bulk(val)
+            }
+        }
+    }' | $redis_cli -p $SRC_PORT --pipe >/dev/null
+}
+
+# print max p99(ms) of redis-benchmark get runs, run while pid $1 alive
+# or only once if no pid; csv latency columns need redis-benchmark 6.2+
+latency_p99() {
+    local pid=$1
+    local max=0
+    while :;do
+        local p99=$($redis_benchmark -p $SRC_PORT -c $LAT_CLIENTS \
+            -n $LAT_REQUESTS -t get --csv 2>/dev/null \
+            | awk -F'","' 'NR==1{for(i=1;i<=NF;i++)if($i~/p99/)c=i}
+                           NR==2{gsub(/"/,"",$c);print $c}')
+        if [[ -n $p99 ]];then
+            max=$(echo "$max $p99" | awk '{print ($2>$1)?$2:$1}')
+        fi
+        if [[ -z $pid ]] || ! kill -0 $pid 2>/dev/null;then
+            break
+        fi
+    done
+    echo $max
+}
+
+info_field() {
+    $redis_cli -p $1 info redisxslot_mgrt | tr -d '\r' \
+        | awk -F: -v f=redisxslot_$2 '$1==f{print $2}'
+}
+
+# migrate all non empty slots, round by round until src slotsinfo empty;
+# slotsmgrtslot mgrt one key per call, slotsmgrttagslot all keys of one tag
+mgrt_all() {
+    local mgrt_type=$1
+    local cmd=slotsmgrtslot
+    if [[ $TAGS -gt 0 ]];then cmd=slotsmgrttagslot;fi
+    while :;do
+        local info=$($redis_cli -p $SRC_PORT slotsinfo 0 $SLOTS | paste - -)
+        if [[ -z $info ]];then
+            break
+        fi
+        echo "$info" | awk -v cmd=$cmd -v port=$DST_PORT \
+            -v timeout=$MGRT_TIMEOUT -v type=$mgrt_type -v tags=$TAGS '{
+            n = (tags > 0) ? 1 : $2
+            for (i = 0; i < n; i++)
+                print cmd, "127.0.0.1", port, timeout, $1, type
+        }' | $redis_cli -p $SRC_PORT >/dev/null
+    done
+}
+
+run_mode() {
+    local mode=$1
+    local load_args="$SLOTS 0"
+    local mgrt_type=""
+    case $mode in
+        sync) ;;
+        async) load_args="$SLOTS 0 async" ;;
+        pool) load_args="$SLOTS $THREADS" ;;
+        withpipeline) mgrt_type="withpipeline" ;;
+        withcompress) mgrt_type="withcompress" ;;
+        withbinary) mgrt_type="withbinary" ;;
+        witheventloop) mgrt_type="witheventloop" ;;
+        withshm) mgrt_type="withshm" ;;
+        *) echo "unknown mode $mode"; exit 1 ;;
+    esac
+
+    stop_server $SRC_PORT
+    stop_server $DST_PORT
+    start_server $SRC_PORT $load_args
+    start_server $DST_PORT $load_args
+    populate
+    local src_keys=$($redis_cli -p $SRC_PORT dbsize)
+    local base_p99=$(latency_p99)
+
+    local keys0=$(info_field $SRC_PORT keys_migrated)
+    local bytes0=$(info_field $SRC_PORT bytes_migrated)
+    local start=$(date +%s%N)
+    mgrt_all "$mgrt_type" &
+    local mgrt_pid=$!
+    local mgrt_p99=$(latency_p99 $mgrt_pid)
+    wait $mgrt_pid
+    local cost_ns=$(($(date +%s%N) - start))
+    local keys=$(($(info_field $SRC_PORT keys_migrated) - keys0))
+    local bytes=$(($(info_field $SRC_PORT bytes_migrated) - bytes0))
+    local dst_keys=$($redis_cli -p $DST_PORT dbsize)
+
+    echo "$mode $src_keys $dst_keys $keys $bytes $cost_ns $base_p99 $mgrt_p99" \
+        | awk '{
+        secs = $6 / 1e9
+        printf "%-13s %9d %9d %8.3f %12.0f %9.2f %12.3f %12.3f\n",
+            $1, $2, $3, secs, $4 / secs, $5 / secs / 1048576, $7, $8
+    }'
+    stop_server $SRC_PORT
+    stop_server $DST_PORT
+}
+
+echo "keys=$KEYS type=$KEY_TYPE fields=$FIELDS val_size=$VAL_SIZE tags=$TAGS" \
+     "slots=$SLOTS threads=$THREADS"
+printf "%-13s %9s %9s %8s %12s %9s %12s %12s\n" mode src_keys dst_keys secs \
+    keys/s MB/s base_p99_ms mgrt_p99_ms
+for mode in $MODES;do
+    run_mode $mode
+done
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2023, weedge <weege007 at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * slots_bench: offline micro benchmark for the slot index ops
+ * (slots_num, slot keys dict add/delete/scan/random key, tagged keys
+ * skiplist insert/range, m_dictRehashMilliseconds) without redis-server,
+ * RedisModule alloc/string api are stubbed with libc.
+ *
+ * make bench BENCH_ARGS="max_keys"
+ */
+#include "redisxslot.h"
+
+slots_meta_info g_slots_meta_info;
+
+// stub RedisModuleString with refcount, like RedisModule_RetainString
+struct RedisModuleString {
+    int refcount;
+    size_t len;
+    char ptr[];
+};
+
+#define BENCH_TAGS 1024
+#define BENCH_TAG_EVERY 8
+#define BENCH_MIN_KEYS 10000
+
+static void* benchAlloc(size_t bytes) {
+    return malloc(bytes);
+}
+
+static void* benchCalloc(size_t nmemb, size_t size) {
+    return calloc(nmemb, size);
+}
+
+static void* benchRealloc(void* ptr, size_t bytes) {
+    return realloc(ptr, bytes);
+}
+
+static void benchFree(void* ptr) {
+    free(ptr);
+}
+
+static const char* benchStringPtrLen(const RedisModuleString* str,
+                                     size_t* len) {
+    if (len != NULL) {
+        *len = str->len;
+    }
+    return str->ptr;
+}
+
+static void benchFreeString(RedisModuleCtx* ctx, RedisModuleString* str) {
+    UNUSED(ctx);
+    if (--str->refcount == 0) {
+        free(str);
+    }
+}
+
+static int benchStringCompare(RedisModuleString* a, RedisModuleString* b) {
+    size_t l = a->len < b->len ? a->len : b->len;
+    int cmp = memcmp(a->ptr, b->ptr, l);
+    if (cmp != 0)
+        return cmp;
+    return a->len < b->len ? -1 : (a->len > b->len ? 1 : 0);
+}
+
+static RedisModuleString* benchCreateString(const char* s, size_t len) {
+    RedisModuleString* str = malloc(sizeof(*str) + len + 1);
+    str->refcount = 1;
+    str->len = len;
+    memcpy(str->ptr, s, len);
+    str->ptr[len] = '\0';
+    return str;
+}
+
+static RedisModuleString* benchRef(RedisModuleString* str) {
+    str->refcount++;
+    return str;
+}
+
+static uint64_t benchNowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void benchReport(const char* name, uint32_t slots, long keys, long ops,
+                        uint64_t ns) {
+    printf("%-18s slots=%-6u keys=%-9ld ops=%-9ld %9.1f ns/op %12.0f ops/s\n",
+           name, slots, keys, ops, ops ? (double)ns / ops : 0,
+           ns ? (double)ops * 1e9 / ns : 0);
+}
+
+// every BENCH_TAG_EVERY key is a tagged key {tagN}, like hash tag keys
+static RedisModuleString** benchCreateKeys(long keys) {
+    char buf[64];
+    RedisModuleString** ks = malloc(sizeof(RedisModuleString*) * keys);
+    for (long i = 0; i < keys; i++) {
+        int len;
+        if (i % BENCH_TAG_EVERY == 0) {
+            len = snprintf(buf, sizeof(buf), "{tag%ld}:key:%ld",
+                           (i / BENCH_TAG_EVERY) % BENCH_TAGS, i);
+        } else {
+            len = snprintf(buf, sizeof(buf), "key:%ld", i);
+        }
+        ks[i] = benchCreateString(buf, len);
+    }
+    return ks;
+}
+
+static void benchFreeKeys(RedisModuleString** ks, long keys) {
+    for (long i = 0; i < keys; i++) {
+        benchFreeString(NULL, ks[i]);
+    }
+    free(ks);
+}
+
+static void benchScanCallback(void* privdata, const m_dictEntry* de) {
+    UNUSED(de);
+    (*(long*)privdata)++;
+}
+
+static void benchSlotsDict(RedisModuleString** ks, long keys, uint32_t slots) {
+    g_slots_meta_info.hash_slots_size = slots;
+    dict** tables = malloc(sizeof(dict*) * slots);
+    for (uint32_t i = 0; i < slots; i++) {
+        tables[i] = m_dictCreate(&hashSlotDictType, NULL);
+    }
+    int* key_slots = malloc(sizeof(int) * keys);
+
+    uint64_t start = benchNowNs();
+    for (long i = 0; i < keys; i++) {
+        uint32_t crc;
+        int hastag;
+        key_slots[i] = slots_num(ks[i]->ptr, &crc, &hastag);
+    }
+    benchReport("slots_num", slots, keys, keys, benchNowNs() - start);
+
+    start = benchNowNs();
+    for (long i = 0; i < keys; i++) {
+        m_dictAdd(tables[key_slots[i]], benchRef(ks[i]), NULL);
+    }
+    benchReport("dict_add", slots, keys, keys, benchNowNs() - start);
+
+    long scanned = 0;
+    start = benchNowNs();
+    for (uint32_t i = 0; i < slots; i++) {
+        unsigned long cursor = 0;
+        do {
+            cursor = m_dictScan(tables[i], cursor, benchScanCallback, NULL,
+                                &scanned);
+        } while (cursor != 0);
+    }
+    benchReport("dict_scan", slots, keys, scanned, benchNowNs() - start);
+
+    start = benchNowNs();
+    for (long i = 0; i < keys; i++) {
+        m_dictGetRandomKey(tables[key_slots[i]]);
+    }
+    benchReport("dict_random_key", slots, keys, keys, benchNowNs() - start);
+
+    start = benchNowNs();
+    for (long i = 0; i < keys; i++) {
+        m_dictDelete(tables[key_slots[i]], ks[i]);
+    }
+    benchReport("dict_delete", slots, keys, keys, benchNowNs() - start);
+
+    for (uint32_t i = 0; i < slots; i++) {
+        m_dictRelease(tables[i]);
+    }
+    free(tables);
+    free(key_slots);
+}
+
+static void benchTaggedSkiplist(RedisModuleString** ks, long keys) {
+    m_zskiplist* zsl = m_zslCreate();
+    long tagged = 0;
+    uint32_t crc;
+
+    uint64_t start = benchNowNs();
+    for (long i = 0; i < keys; i += BENCH_TAG_EVERY) {
+        slots_num(ks[i]->ptr, &crc, NULL);
+        m_zslInsert(zsl, (long long)crc, benchRef(ks[i]));
+        tagged++;
+    }
+    benchReport("zsl_insert", 0, keys, tagged, benchNowNs() - start);
+
+    long ranges = 0, visited = 0;
+    start = benchNowNs();
+    for (long i = 0; i < keys && ranges < BENCH_TAGS;
+         i += BENCH_TAG_EVERY, ranges++) {
+        slots_num(ks[i]->ptr, &crc, NULL);
+        m_zrangespec range
+            = {.min = (long long)crc, .max = (long long)crc, .minex = 0,
+               .maxex = 0};
+        m_zskiplistNode* node = m_zslFirstInRange(zsl, &range);
+        while (node != NULL && node->score == (long long)crc) {
+            visited++;
+            node = node->level[0].forward;
+        }
+    }
+    benchReport("zsl_range", 0, keys, ranges, benchNowNs() - start);
+    printf("%-18s tagged=%ld visited=%ld\n", "zsl_range", tagged, visited);
+
+    m_zslFree(zsl);
+}
+
+// fill one dict, then double it like an add triggered expand and measure
+// how long 1ms m_dictRehashMilliseconds steps (cron rehash) take to finish.
+static void benchRehash(RedisModuleString** ks, long keys) {
+    dict* d = m_dictCreate(&hashSlotDictType, NULL);
+    for (long i = 0; i < keys; i++) {
+        m_dictAdd(d, benchRef(ks[i]), NULL);
+    }
+    while (dictIsRehashing(d)) {
+        m_dictRehash(d, 100);
+    }
+
+    unsigned long from = dictSlots(d);
+    if (m_dictExpand(d, from * 2) != DICT_OK) {
+        m_dictRelease(d);
+        return;
+    }
+    long calls = 0;
+    uint64_t start = benchNowNs();
+    while (dictIsRehashing(d)) {
+        m_dictRehashMilliseconds(d, 1);
+        calls++;
+    }
+    uint64_t ns = benchNowNs() - start;
+    benchReport("dict_rehash_ms", 1, keys, from, ns);
+    printf("%-18s buckets=%lu->%lu calls=%ld total=%.3f ms\n",
+           "dict_rehash_ms", from, (unsigned long)dictSlots(d), calls,
+           (double)ns / 1e6);
+    m_dictRelease(d);
+}
+
+int main(int argc, char** argv) {
+    long max_keys = argc > 1 ? atol(argv[1]) : 1000000;
+    if (max_keys < BENCH_MIN_KEYS) {
+        max_keys = BENCH_MIN_KEYS;
+    }
+    uint32_t slot_sizes[]
+        = {DEFAULT_HASH_SLOTS_SIZE, 16384, MAX_HASH_SLOTS_SIZE};
+
+    RedisModule_Alloc = benchAlloc;
+    RedisModule_Calloc = benchCalloc;
+    RedisModule_Realloc = benchRealloc;
+    RedisModule_Free = benchFree;
+    RedisModule_StringPtrLen = benchStringPtrLen;
+    RedisModule_FreeString = benchFreeString;
+    RedisModule_StringCompare = benchStringCompare;
+    crc32_init();
+    srandom(0);
+
+    for (long keys = BENCH_MIN_KEYS; keys <= max_keys; keys *= 10) {
+        RedisModuleString** ks = benchCreateKeys(keys);
+        for (size_t i = 0; i < sizeof(slot_sizes) / sizeof(slot_sizes[0]);
+             i++) {
+            benchSlotsDict(ks, keys, slot_sizes[i]);
+        }
+        benchTaggedSkiplist(ks, keys);
+        benchRehash(ks, keys);
+        benchFreeKeys(ks, keys);
+        printf("\n");
+    }
+    return 0;
+}
@@ -107,6 +107,106 @@ proc test_local_cmd {r slotsize} {
         }
     }
 
+    test "test slotsinfo range and key counts - slotsize: $slotsize" {
+        flush_db $r 0 $slotsize
+
+        set n 10
+        set key_list [add_test_data $r $n "tag0"]
+        set slot [expr {[crc::crc32 "tag0"]%$slotsize}]
+        assert_equal [list [list $slot $n]] [$r slotsinfo $slot 1]
+        assert_equal [list [list $slot $n]] [$r slotsinfo 0 [expr {$slot+1}]]
+        assert_equal 0 [llength [$r slotsinfo [expr {$slot+1}] $slotsize]]
+        assert_equal 0 [llength [$r slotsinfo 0 $slot]]
+        $r del [lindex $key_list 0]
+        assert_equal [list [list $slot [expr {$n-1}]]] [$r slotsinfo 0 $slotsize]
+        foreach key $key_list {
+            $r del $key
+        }
+        assert_equal 0 [llength [$r slotsinfo 0 $slotsize]]
+    }
+
+    test "test slotsmemory - slotsize: $slotsize" {
+        flush_db $r 0 $slotsize
+
+        set n 10
+        add_test_data $r $n "tag0"
+        set slot [expr {[crc::crc32 "tag0"]%$slotsize}]
+        set res [$r slotsmemory]
+        assert_equal 1 [llength $res]
+        assert_equal $slot [lindex [lindex $res 0] 0]
+        assert_equal $n [lindex [lindex $res 0] 1]
+        assert {[lindex [lindex $res 0] 2] > 0}
+        set res [$r slotsmemory $slot 1 samples 4]
+        assert_equal $slot [lindex [lindex $res 0] 0]
+        assert {[lindex [lindex $res 0] 2] > 0}
+        assert_equal 0 [llength [$r slotsmemory 0 $slot]]
+        assert_error "*syntax*" {$r slotsmemory 0 $slotsize samples 0}
+
+        assert_equal OK [$r slotsmemory bgscan]
+        wait_for_condition 50 100 {
+            [lindex [lindex [$r slotsmemory full $slot 1] 0] 2] > 0
+        } else {
+            fail "slotsmemory bgscan not done"
+        }
+        assert_equal $n [lindex [lindex [$r slotsmemory full $slot 1] 0] 1]
+        assert_equal 0 [llength [$r slotsmemory 9223372036854775807 9223372036854775807]]
+        # 16384 / 1024 samples: 16 sampled slots per call
+        for {set i 0} {$i < 64} {incr i} {
+            $r set "memkey{$i}" val
+        }
+        assert_equal 16 [llength [$r slotsmemory 0 $slotsize samples 1024]]
+    }
+
+    test "test slotsheat - slotsize: $slotsize" {
+        flush_db $r 0 $slotsize
+        assert_equal OK [$r slotsheat reset]
+        assert_equal 0 [llength [$r slotsheat]]
+
+        set slot [expr {[crc::crc32 "tag1"]%$slotsize}]
+        for {set i 0} {$i < 10} {incr i} {
+            $r set "{tag1}$i" $i
+        }
+        set res [$r slotsheat 1 writes]
+        assert_equal 1 [llength $res]
+        assert_equal [list $slot 10 0] [lindex $res 0]
+
+        assert_equal OK [$r slotsconfig set heat_read_tracking yes]
+        $r get "{tag1}0"
+        $r mget "{tag1}1" "{tag1}2"
+        assert_equal [list $slot 10 3] [lindex [$r slotsheat 1 reads] 0]
+        assert_equal OK [$r slotsconfig set heat_read_tracking no]
+        $r get "{tag1}0"
+        assert_equal [list $slot 10 3] [lindex [$r slotsheat] 0]
+
+        assert_error "*syntax*" {$r slotsheat 0}
+        assert_error "*syntax*" {$r slotsheat 1 none}
+        assert_equal OK [$r slotsheat reset]
+        assert_equal 0 [llength [$r slotsheat]]
+    }
+
+    test "test slotshotkeys - slotsize: $slotsize" {
+        flush_db $r 0 $slotsize
+        assert_equal 0 [llength [$r slotshotkeys]]
+
+        assert_equal OK [$r slotsconfig set hotkeys_tracking yes]
+        set slot [expr {[crc::crc32 "tag2"]%$slotsize}]
+        for {set i 0} {$i < 10} {incr i} {
+            $r incr "{tag2}hot"
+        }
+        $r set "{tag2}cold" 1
+        set res [$r slotshotkeys $slot]
+        assert_equal 2 [llength $res]
+        assert_equal [list "{tag2}hot" $slot 10] [lindex $res 0]
+        assert_equal [list "{tag2}cold" $slot 1] [lindex $res 1]
+
+        $r del "{tag2}hot"
+        assert_equal 1 [llength [$r slotshotkeys]]
+        assert_error "*syntax*" {$r slotshotkeys $slotsize}
+        assert_equal OK [$r slotshotkeys reset]
+        assert_equal 0 [llength [$r slotshotkeys]]
+        assert_equal OK [$r slotsconfig set hotkeys_tracking no]
+    }
+
     test "test slotsscan - slotsize: $slotsize" {
         flush_db $r 0 $slotsize
 
@@ -135,6 +235,36 @@ proc test_local_cmd {r slotsize} {
         }
     }
 
+    test "test slotsconfig - slotsize: $slotsize" {
+        assert_equal {mgrt_batch_budget_us 0} [$r slotsconfig get mgrt_batch_budget_us]
+        assert_equal OK [$r slotsconfig set mgrt_batch_budget_us 1000]
+        assert_equal {mgrt_batch_budget_us 1000} [$r slotsconfig get mgrt_batch_*]
+        assert_error "*syntax*" {$r slotsconfig set mgrt_batch_budget_us -1}
+        assert_error "*syntax*" {$r slotsconfig set not_exists_option 1}
+        assert_equal OK [$r slotsconfig set mgrt_batch_budget_us 0]
+        assert_equal {yield_keys 1000} [$r slotsconfig get yield_keys]
+        assert_equal {yield_us 1000} [$r slotsconfig get yield_us]
+        assert_equal {mgrt_shm_ring_bytes 67108864} [$r slotsconfig get mgrt_shm_ring_bytes]
+        assert_equal {mgrt_pipeline_window 4} [$r slotsconfig get mgrt_pipeline_window]
+        assert_error "*syntax*" {$r slotsconfig set mgrt_pipeline_window 0}
+    }
+
+    test "test slotsstats - slotsize: $slotsize" {
+        assert_equal OK [$r slotsstats reset]
+        assert_equal OK [$r slotsconfig set latency_tracking yes]
+        $r set stats_key_1 1
+        $r del stats_key_1
+        assert_equal OK [$r slotsconfig set latency_tracking no]
+        set res [$r slotsstats]
+        assert_equal 5 [llength $res]
+        assert_equal slots_add [lindex [lindex $res 0] 0]
+        assert {[lindex [lindex $res 0] 2] >= 1}
+        assert {[lindex [lindex $res 1] 2] >= 1}
+        assert_equal OK [$r slotsstats reset]
+        assert_equal 0 [lindex [lindex [$r slotsstats] 0] 2]
+        assert_error "*syntax*" {$r slotsstats not_exists}
+    }
+
     test "test slotsdel - slotsize: $slotsize" {
         flush_db $r 0 $slotsize
 
@@ -150,6 +280,50 @@ proc test_local_cmd {r slotsize} {
             assert_equal 0 [lindex [lindex $res 0] 1]
         }
     }
+
+    test "test slotsdel replicate one unlink per scan step - slotsize: $slotsize" {
+        flush_db $r 0 $slotsize
+
+        set n 100
+        add_test_data $r $n "tag0"
+        set slot [expr {[crc::crc32 "tag0"]%$slotsize}]
+        set repl [attach_to_replication_stream]
+        $r slotsdel $slot
+        $r set slotsdel_done 1
+        set unlinks 0
+        set keys 0
+        while 1 {
+            set cmd [read_from_replication_stream $repl]
+            set name [string tolower [lindex $cmd 0]]
+            if {$name eq "set" || $name eq ""} break
+            if {$name eq "unlink"} {
+                incr unlinks
+                incr keys [expr {[llength $cmd]-1}]
+            }
+        }
+        close_replication_stream $repl
+        assert_equal $n $keys
+        assert {$unlinks < $n}
+        $r del slotsdel_done
+    }
+
+    test "test slotsdel yield every key - slotsize: $slotsize" {
+        flush_db $r 0 $slotsize
+        assert_equal OK [$r slotsconfig set yield_keys 1]
+
+        set n 100
+        set tag_list {"tag0" "tag1" "tag2" "tag3" "tag4" "tag5"}
+        set slot_list [put_slot_list $r $slotsize $n $tag_list]
+        assert_equal [llength $slot_list] [llength $tag_list]
+        foreach slot $slot_list {
+            set res [$r slotsdel $slot]
+            assert_equal 1 [llength $res]
+            assert_equal 2 [llength [lindex $res 0]]
+            assert_equal $slot [lindex [lindex $res 0] 0]
+            assert_equal 0 [lindex [lindex $res 0] 1]
+        }
+        assert_equal OK [$r slotsconfig set yield_keys 1000]
+    }
 }
 
 proc test_slotsmgrtone {src dest dest_host dest_port slotsize withpipeline} {
@@ -345,6 +519,142 @@ proc test_mgrtslot {src dest dest_host dest_port slotsize} {
     test "test slotsmgrttagslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt withpipeline" {
         test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize "withpipeline"
     }
+
+    test "test slotsmgrttagslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt withcompress" {
+        test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize "withcompress"
+    }
+
+    test "test slotsmgrtone dest $dest_host:$dest_port - slotsize: $slotsize mgrt withcompress big val" {
+        flush_db $src 0 $slotsize
+        flush_db $dest 0 $slotsize
+        set val [string repeat "{\"field\":\"value\"}" 100]
+        $src set lzfkey $val
+        assert_equal 1 [$src slotsmgrtone $dest_host $dest_port 1000 lzfkey withcompress]
+        assert_equal 0 [$src exists lzfkey]
+        assert_equal $val [$dest get lzfkey]
+        set info [$src info redisxslot_mgrt]
+        assert {[getInfoProperty $info redisxslot_compress_bytes] < [getInfoProperty $info redisxslot_compress_raw_bytes]}
+    }
+
+    test "test slotsmgrtslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt withbinary" {
+        test_slotsmgrtslot $src $dest $dest_host $dest_port $slotsize "withbinary"
+    }
+    test "test slotsmgrttagslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt withbinary,withcompress" {
+        test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize "withbinary,withcompress"
+    }
+
+    test "test slotsmgrttagslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt witheventloop" {
+        set version [getInfoProperty [$src info server] redis_version]
+        if {[package vcompare $version 7.0.0] < 0} {
+            assert_error "*ERR*" {$src slotsmgrtslot $dest_host $dest_port 1000 0 witheventloop}
+        } else {
+            test_slotsmgrtslot $src $dest $dest_host $dest_port $slotsize "witheventloop"
+            test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize "witheventloop,withcompress"
+        }
+    }
+
+    test "test slotsmgrtone closed port - slotsize: $slotsize mgrt witheventloop" {
+        set version [getInfoProperty [$src info server] redis_version]
+        if {[package vcompare $version 7.0.0] >= 0} {
+            flush_db $src 0 $slotsize
+            $src set loopkey val
+            assert_error "*ERR*" {$src slotsmgrtone 127.0.0.1 1 1000 loopkey witheventloop}
+            assert_error "*ERR*" {$src slotsmgrtone 127.0.0.1 1 1000 loopkey witheventloop}
+            assert_equal PONG [$src ping]
+            assert_equal val [$src get loopkey]
+        }
+    }
+
+    test "test slotsrestorebin invalid batch dest $dest_host:$dest_port - slotsize: $slotsize" {
+        assert_error "*ERR*" {$dest slotsrestorebin "RXSB-not-a-batch"}
+        assert_error "*ERR*" {$dest slotsrestorelzf lzfbig 0 999999999999 x}
+        assert_error "*ERR*" {$dest slotsrestorelzf lzfbig 0 1000 x}
+    }
+
+    test "test slotsmgrttagslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt withshm" {
+        test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize "withshm"
+        test_slotsmgrtslot $src $dest $dest_host $dest_port $slotsize "withshm,withcompress"
+        set info [$src info redisxslot_mgrt]
+        assert {[getInfoProperty $info redisxslot_shm_bytes] > 0}
+    }
+
+    test "test slotsrestoreshm invalid ring dest $dest_host:$dest_port - slotsize: $slotsize" {
+        assert_error "*ERR*" {$dest slotsrestoreshm "/not-a-redisxslot-ring" 0 16}
+        assert_error "*ERR*" {$dest slotsrestoreshm "/redisxslot-not-exists" 0 16}
+    }
+
+    test "test slotsmgrtconnect dest $dest_host:$dest_port - slotsize: $slotsize" {
+        assert_equal 2 [$src slotsmgrtconnect $dest_host $dest_port 1000 2]
+        set info [$src info redisxslot_mgrt]
+        assert {[getInfoProperty $info redisxslot_conns_cached] >= 2}
+        test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize ""
+        assert_error "*ERR*" {$src slotsmgrtconnect $dest_host $dest_port 1000 0}
+        assert_error "*ERR*" {$src slotsmgrtconnect 127.0.0.1 1 100}
+    }
+
+    test "test slotsmgrtone stale pooled conn dest $dest_host:$dest_port - slotsize: $slotsize" {
+        assert_equal 2 [$src slotsmgrtconnect $dest_host $dest_port 1000 2]
+        # the target closes the idle pooled conns
+        foreach line [split [$dest client list] "\n"] {
+            if {[regexp {^id=(\d+) .* cmd=ping} $line -> id]} {
+                $dest client kill id $id
+            }
+        }
+        flush_db $src 0 $slotsize
+        $src set stalekey val
+        assert_equal 1 [$src slotsmgrtone $dest_host $dest_port 1000 stalekey]
+        assert_equal 0 [$src exists stalekey]
+        assert_equal val [$dest get stalekey]
+    }
+
+    test "test slotsmgrttagslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt pipeline window 1" {
+        assert_equal OK [$src slotsconfig set mgrt_pipeline_window 1]
+        test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize "withbinary"
+        assert_equal OK [$src slotsconfig set mgrt_pipeline_window 4]
+    }
+
+    test "test slotsmgrttagslot dest $dest_host:$dest_port - slotsize: $slotsize mgrt adaptive batch" {
+        assert_equal OK [$src slotsconfig set mgrt_batch_budget_us 1000]
+        test_slotsmgrttagslot $src $dest $dest_host $dest_port $slotsize ""
+        assert_equal OK [$src slotsconfig set mgrt_batch_budget_us 0]
+    }
+
+    test "test info mgrt stats dest $dest_host:$dest_port - slotsize: $slotsize" {
+        set info [$src info redisxslot_mgrt]
+        assert {[getInfoProperty $info redisxslot_keys_migrated] > 0}
+        assert {[getInfoProperty $info redisxslot_keys_deleted] > 0}
+        assert_equal 0 [getInfoProperty $info redisxslot_inflight_batches]
+        assert_equal 0 [getInfoProperty $info redisxslot_send_errors]
+        assert_equal 0 [getInfoProperty $info redisxslot_epoch_slow_readers]
+        set info [$dest info redisxslot_mgrt]
+        assert {[getInfoProperty $info redisxslot_keys_restored] > 0}
+        set info [$src info redisxslot_mgrtlatency]
+        assert_match "*redisxslot_send_latency_us:*count=*" $info
+    }
+
+    test "test slotsmgrttagone mgrt adaptive batch err after first batch dest $dest_host:$dest_port - slotsize: $slotsize" {
+        flush_db $src 0 $slotsize
+        flush_db $dest 0 $slotsize
+        assert_equal OK [$src slotsconfig set mgrt_batch_budget_us 1000000]
+        set info [$src info redisxslot_mgrt]
+        set k [getInfoProperty $info redisxslot_batch_keys]
+        set bytes [getInfoProperty $info redisxslot_batch_bytes]
+        # first batch is sent as one cmd, the target rejects (oom) the second
+        set vsize [expr {$bytes / (2 * $k)}]
+        set n [expr {$k * 2 + 16}]
+        set val [string repeat x $vsize]
+        for {set i 0} {$i < $n} {incr i} {
+            $src set "$i{errtag}" $val
+        }
+        set used [getInfoProperty [$dest info memory] used_memory]
+        $dest config set maxmemory [expr {$used + $k * $vsize / 2}]
+        set ret [$src slotsmgrttagone $dest_host $dest_port 1000 "0{errtag}"]
+        $dest config set maxmemory 0
+        assert_equal OK [$src slotsconfig set mgrt_batch_budget_us 0]
+        assert_equal $k $ret
+        assert_equal [expr {$n - $k}] [$src dbsize]
+        assert_equal $k [$dest dbsize]
+    }
 }
 
 proc test_bg_mgrtslot {src dest dest_host dest_port slotsize} {
@@ -385,6 +695,12 @@ proc test_mgrt_cmd {r slotsize testmodule} {
         set dest_host [srv 0 host]
         set dest_port [srv 0 port]
         test_mgrtslot $src $dest $dest_host $dest_port $slotsize
+
+        set dest_unix "unix:[srv 0 unixsocket]"
+        test "test slotsmgrttagslot dest $dest_unix - slotsize: $slotsize mgrt withpipeline" {
+            test_slotsmgrttagslot $src $dest $dest_unix 0 $slotsize "withpipeline"
+            test_slotsmgrtslot $src $dest [srv 0 unixsocket] 0 $slotsize "withbinary"
+        }
     }
 
     start_server [list overrides [list loadmodule "$testmodule $slotsize 0 async"]] {
@@ -445,6 +761,27 @@ tags "modules" {
         }
     }
 
+    test {start redis server loadmodule: default 1024 slots - no thread pool - bg rehash} {
+        start_server [list overrides [list loadmodule "$testmodule 1024 0 bg_rehash yes"]] {
+            print_module_args r
+            assert_equal {bg_rehash 1} [r slotsconfig get bg_rehash]
+            assert_error "*syntax*" {r slotsconfig set bg_rehash no}
+            test_local_cmd r 1024
+            test_mgrt_cmd r 1024 $testmodule
+            test_unload r
+        }
+    }
+
+    test {start redis server loadmodule: default 1024 slots - thread pool size 4 - async block - 128 lock stripes} {
+        start_server [list overrides [list loadmodule "$testmodule 1024 4 async lock_stripes 100"]] {
+            print_module_args r
+            assert_equal {lock_stripes 128} [r slotsconfig get lock_stripes]
+            test_local_cmd r 1024
+            test_mgrt_cmd r 1024 $testmodule
+            test_unload r
+        }
+    }
+
     test {start redis server loadmodule: 65536 slots - no thread pool - no async block} {
         start_server [list overrides [list loadmodule "$testmodule 65536"]] {
             print_module_args r